@@ -0,0 +1,163 @@
+/*
+ * Receive front-end. Every edge of the receiver output on pin 8 (ICP1) is
+ * timestamped by the input capture unit of timer 1, glitches are merged into
+ * the following pulse as pulse_filter() does on the host, and the pulses are
+ * sent in blocks, see src/edge_stream.h for the format. The host is woken up
+ * once per block instead of once per edge.
+ *
+ * When the line can not keep up the pulses are dropped and the sequence
+ * number skips one, the host counts it as a lost block.
+ */
+
+#define EDGE_STREAM_MAGIC 0xe5
+#define EDGE_STREAM_HEADER 4
+#define EDGE_STREAM_PAYLOAD 240
+
+/* same as PULSE_GLITCH, micro seconds */
+#define GLITCH 200
+
+/* a block is sent at least this often while there is signal, micro seconds */
+#define FLUSH_US 20000
+
+/* timer 1 at 2 ticks per micro second */
+#define TICKS_PER_US 2
+
+/* must be a power of two */
+#define RING_SIZE 128
+#define RING_MASK (RING_SIZE - 1)
+
+struct record {
+    unsigned char level;
+    unsigned long us;
+};
+
+/* written by the capture interrupt only */
+static volatile unsigned int overflows;
+static unsigned long last_capture, merged;
+static volatile unsigned char head, dropped;
+
+/* written by the loop only */
+static volatile unsigned char tail;
+
+static struct record ring[RING_SIZE];
+
+static unsigned char block[EDGE_STREAM_HEADER + EDGE_STREAM_PAYLOAD + 1];
+static unsigned char len, count, seq;
+static unsigned long block_started;
+
+static unsigned char crc8(const unsigned char *buffer, unsigned char len) {
+    unsigned char crc = 0, i, b;
+
+    for (i = 0; i != len; i++) {
+        crc ^= buffer[i];
+        for (b = 0; b != 8; b++) {
+            crc = crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1;
+        }
+    }
+
+    return crc;
+}
+
+ISR(TIMER1_OVF_vect) {
+    overflows++;
+}
+
+ISR(TIMER1_CAPT_vect) {
+    unsigned int captured = ICR1;
+    unsigned long now, us;
+    unsigned char level, next;
+
+    /* the edge that was captured, the pulse ending is of the other level */
+    level = (TCCR1B & _BV(ICES1)) == 0;
+    TCCR1B ^= _BV(ICES1);
+
+    /* an overflow pending before the capture is not counted yet */
+    now = overflows;
+    if ((TIFR1 & _BV(TOV1)) && captured < 0x8000) {
+        now++;
+    }
+    now = now << 16 | captured;
+
+    us = (now - last_capture) / TICKS_PER_US;
+    last_capture = now;
+
+    merged += us;
+    if (us <= GLITCH) {
+        return;
+    }
+
+    next = (head + 1) & RING_MASK;
+    if (next == tail) {
+        dropped = 1;
+    } else {
+        ring[head].level = level;
+        ring[head].us = merged;
+        head = next;
+    }
+    merged = 0;
+}
+
+static void flush_block(void) {
+    if (count == 0) {
+        return;
+    }
+
+    block[0] = EDGE_STREAM_MAGIC;
+    block[1] = seq++;
+    block[2] = count;
+    block[3] = len;
+    block[EDGE_STREAM_HEADER + len] = crc8(block, EDGE_STREAM_HEADER + len);
+    Serial.write(block, EDGE_STREAM_HEADER + len + 1);
+
+    len = count = 0;
+}
+
+/* room is left for a record of 5 bytes, the longest a duration takes */
+static void add_record(const struct record *record) {
+    unsigned long value = record->us << 1 | record->level;
+
+    if (count == 0) {
+        block_started = micros();
+    }
+    while (value >= 0x80) {
+        block[EDGE_STREAM_HEADER + len++] = value | 0x80;
+        value >>= 7;
+    }
+    block[EDGE_STREAM_HEADER + len++] = value;
+
+    if (++count == 255 || len > EDGE_STREAM_PAYLOAD - 5) {
+        flush_block();
+    }
+}
+
+void setup(void) {
+    pinMode(8, INPUT);
+
+    /* normal mode, prescaler 8, capture of the rising edges first */
+    TCCR1A = 0;
+    TCCR1B = _BV(CS11) | _BV(ICES1);
+    TIFR1 = _BV(ICF1) | _BV(TOV1);
+    TIMSK1 = _BV(ICIE1) | _BV(TOIE1);
+
+    Serial.begin(115200);
+}
+
+void loop(void) {
+    struct record record;
+
+    while (tail != head) {
+        record = ring[tail];
+        tail = (tail + 1) & RING_MASK;
+        add_record(&record);
+    }
+
+    if (dropped) {
+        flush_block();
+        seq++;
+        dropped = 0;
+    }
+
+    if (count && micros() - block_started > FLUSH_US) {
+        flush_block();
+    }
+}
@@ -1,159 +1,395 @@
-enum COMMAND {
-    UNKNOWN = 0,
-    MY = 1,
-    UP,
-    MY_UP,
-    DOWN,
-    MY_DOWN,
-    UP_DOWN,
-    PROG = 8,
-    SUN_FLAG,
-    FLAG,
+/*
+ * Transmit coprocessor. The host sends compact commands over the serial line,
+ * see src/serial.h for the messages, the frames are rendered here by the
+ * output compare unit of timer 1, every edge is set by the hardware on pin
+ * 10 (OC1B) whatever the interrupt latency, and the timing measured is sent
+ * back once done.
+ *
+ * The protocol descriptions mirror src/ook_protocols.h, keep them in sync.
+ */
+
+#define SERIAL_COMMAND_MAGIC 0xd7
+#define SERIAL_ACK_MAGIC 0xa7
+#define SERIAL_COMMAND_SIZE 15
+#define SERIAL_ACK_SIZE 11
+
+enum SERIAL_FLAGS {
+    SERIAL_REPEATED = 1,
+    SERIAL_GROUP = 2
 };
 
-struct srts_payload {
-    unsigned char key;
-    unsigned char checksum :4;
-    unsigned char ctrl :4;
-    unsigned short code;
-    struct address {
-        unsigned char byte1;
-        unsigned char byte2;
-        unsigned char byte3;
-    } address;
+enum SERIAL_STATUS {
+    SERIAL_READY = 0,
+    SERIAL_ACCEPTED,
+    SERIAL_DONE,
+    SERIAL_BAD_CRC,
+    SERIAL_BAD_COMMAND
 };
 
+enum PROTOCOL {
+    PROTOCOL_SRTS = 0,
+    PROTOCOL_HOMEASY,
+    PROTOCOL_COUNT
+};
 
-static void checksum_payload(struct srts_payload *payload) {
-    unsigned char *p = (unsigned char *) payload;
-    unsigned char checksum = 0;
-    int i = 0;
+#define OOK_ELEMENTS 4
+#define OOK_MAX_BITS 64
 
-    for (i = 0; i < 7; i++) {
-        checksum = checksum ^ p[i] ^ (p[i] >> 4);
-    }
-    checksum = checksum & 0xf;
-    payload->checksum = checksum;
-}
+struct ook_element {
+    unsigned char level;
+    unsigned long us;
+};
 
-static void write_bit(int pin, char bit) {
-    if (bit) {
-        digitalWrite(pin, LOW);
-        delayMicroseconds(660);
-        digitalWrite(pin, HIGH);
-        delayMicroseconds(660);
-    } else {
-        digitalWrite(pin, HIGH);
-        delayMicroseconds(660);
-        digitalWrite(pin, LOW);
-        delayMicroseconds(660);
+struct ook_sequence {
+    unsigned char count;
+    struct ook_element elements[OOK_ELEMENTS];
+};
+
+struct ook_protocol {
+    struct ook_sequence wakeup;
+    struct ook_sequence sync;
+    unsigned char syncs;
+    unsigned char repeat_syncs;
+    struct ook_sequence start;
+    struct ook_sequence symbols[2];
+    unsigned char bits;
+    struct ook_sequence trailer;
+};
+
+static const struct ook_protocol protocols[PROTOCOL_COUNT] = {
+    /* Somfy RTS */
+    {
+        { 2, { { 1, 12400 }, { 0, 80600 } } },
+        { 2, { { 1, 2560 }, { 0, 2560 } } }, 2, 7,
+        { 2, { { 1, 4800 }, { 0, 660 } } },
+        {
+            { 2, { { 1, 660 }, { 0, 660 } } },
+            { 2, { { 0, 660 }, { 1, 660 } } },
+        },
+        56,
+        { 1, { { 0, 30400 } } },
+    },
+    /* HomeEasy */
+    {
+        { 0 },
+        { 2, { { 1, 275 }, { 0, 9900 } } }, 1, 1,
+        { 2, { { 1, 275 }, { 0, 2600 } } },
+        {
+            { 4, { { 1, 300 }, { 0, 300 }, { 1, 300 }, { 0, 1300 } } },
+            { 4, { { 1, 300 }, { 0, 1300 }, { 1, 300 }, { 0, 300 } } },
+        },
+        32,
+        { 2, { { 1, 275 }, { 0, 10000 } } },
+    },
+};
+
+enum SECTION {
+    SECTION_WAKEUP = 0,
+    SECTION_SYNC,
+    SECTION_START,
+    SECTION_BITS,
+    SECTION_TRAILER,
+    SECTION_END
+};
+
+/* timer 1 at 2 ticks per micro second, long pulses are set in chunks */
+#define TICKS_PER_US 2
+#define MAX_CHUNK 60000
+
+static const int pin = 10;
+
+/* the train being sent, walked by the compare interrupt */
+static const struct ook_protocol *protocol;
+static unsigned char bits[OOK_MAX_BITS / 8];
+static unsigned char frames, frame, section, rep, element;
+static unsigned char repeated;
+
+static unsigned long left;
+static unsigned int late;
+static volatile unsigned char ending, done;
+
+static unsigned char busy, last_seq, has_last;
+static unsigned char last_frames;
+static unsigned long started, airtime;
+
+static unsigned char crc8(const unsigned char *buffer, unsigned char len) {
+    unsigned char crc = 0, i, b;
+
+    for (i = 0; i != len; i++) {
+        crc ^= buffer[i];
+        for (b = 0; b != 8; b++) {
+            crc = crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1;
+        }
     }
+
+    return crc;
 }
 
-static void write_byte(int pin, unsigned char byte) {
-    unsigned int mask;
+static void send_ack(unsigned char seq, unsigned char status,
+        unsigned char count, unsigned long us, unsigned int late_us) {
+    unsigned char buffer[SERIAL_ACK_SIZE];
 
-    for (mask = 0b10000000; mask != 0x0; mask >>= 1) {
-        write_bit(pin, byte & mask);
-    }
+    buffer[0] = SERIAL_ACK_MAGIC;
+    buffer[1] = seq;
+    buffer[2] = status;
+    buffer[3] = count;
+    buffer[4] = us;
+    buffer[5] = us >> 8;
+    buffer[6] = us >> 16;
+    buffer[7] = us >> 24;
+    buffer[8] = late_us;
+    buffer[9] = late_us >> 8;
+    buffer[10] = crc8(buffer, SERIAL_ACK_SIZE - 1);
+
+    Serial.write(buffer, SERIAL_ACK_SIZE);
 }
 
-static void write_payload(int pin, struct srts_payload *payload) {
-    unsigned char *p = (unsigned char *) payload;
+/* checksum then obfuscate the 7 bytes of a Somfy frame */
+static void srts_bits(unsigned long address, unsigned char command,
+        unsigned char key, unsigned int code) {
+    unsigned char checksum = 0;
     int i;
 
+    bits[0] = key;
+    bits[1] = command << 4;
+    bits[2] = code >> 8;
+    bits[3] = code;
+    bits[4] = address;
+    bits[5] = address >> 8;
+    bits[6] = 0;
+
     for (i = 0; i < 7; i++) {
-        write_byte(pin, p[i]);
+        checksum = checksum ^ bits[i] ^ (bits[i] >> 4);
+    }
+    bits[1] |= checksum & 0xf;
+
+    for (i = 1; i < 7; i++) {
+        bits[i] = bits[i] ^ bits[i - 1];
     }
 }
 
-static void obfuscate_payload(struct srts_payload *payload) {
-    unsigned char *p = (unsigned char *) payload;
-    int i = 0;
+/* 26 bits of address, the group flag, the command and 4 bits of receiver */
+static void homeasy_bits(unsigned long address, unsigned char command,
+        unsigned char receiver, unsigned char group) {
+    unsigned long word;
 
-    for (i = 1; i < 7; i++) {
-        p[i] = p[i] ^ p[i - 1];
+    word = address << 6 | (unsigned long) (group != 0) << 5 |
+        (command != 0) << 4 | (receiver & 0xf);
+    bits[0] = word >> 24;
+    bits[1] = word >> 16;
+    bits[2] = word >> 8;
+    bits[3] = word;
+}
+
+static const struct ook_sequence *section_sequence(unsigned char *count) {
+    unsigned char bit;
+
+    switch (section) {
+        case SECTION_WAKEUP:
+            *count = frame == 0 && ! repeated;
+            return &protocol->wakeup;
+        case SECTION_SYNC:
+            *count = frame == 0 && ! repeated ? protocol->syncs :
+                protocol->repeat_syncs;
+            return &protocol->sync;
+        case SECTION_START:
+            *count = 1;
+            return &protocol->start;
+        case SECTION_BITS:
+            *count = protocol->bits;
+            bit = (bits[rep / 8] >> (7 - rep % 8)) & 1;
+            return &protocol->symbols[bit];
+        default:
+            *count = 1;
+            return &protocol->trailer;
     }
 }
 
-static void sync_transmit(int pin, int repeated) {
-    int count, i;
+/* the next pulse of the train, 0 once every frame is sent */
+static int next_pulse(unsigned char *level, unsigned long *us) {
+    const struct ook_sequence *sequence;
+    unsigned char count;
 
-    if (repeated) {
-        count = 7;
-    } else {
-        digitalWrite(pin, HIGH);
-        delayMicroseconds(12400);
-        digitalWrite(pin, LOW);
-        for(i = 0; i != 5; i++) {
-          delayMicroseconds(16000);
+    while (frame != frames) {
+        sequence = section_sequence(&count);
+        if (rep < count && element < sequence->count) {
+            *level = sequence->elements[element].level;
+            *us = sequence->elements[element].us;
+            element++;
+            return 1;
+        }
+
+        element = 0;
+        if (rep < count && ++rep < count) {
+            continue;
+        }
+        rep = 0;
+        if (++section == SECTION_END) {
+            section = SECTION_WAKEUP;
+            frame++;
         }
-        delayMicroseconds(600);
-        count = 2;
     }
-    for (i = 0; i != count; i++) {
-        digitalWrite(pin, HIGH);
-        delayMicroseconds(2560);
-        digitalWrite(pin, LOW);
-        delayMicroseconds(2560);
+
+    return 0;
+}
+
+/* the level the output takes at the next compare match */
+static void set_on_compare(unsigned char level) {
+    if (level) {
+        TCCR1A |= _BV(COM1B1) | _BV(COM1B0);
+    } else {
+        TCCR1A = (TCCR1A & ~_BV(COM1B0)) | _BV(COM1B1);
     }
 }
 
-void static write_interval_gap(int pin) {
-  int i;
+/*
+ * Program the compare that ends the current chunk, at that point the output
+ * takes the level of the next pulse, or stays the same between chunks.
+ */
+static void program(void) {
+    unsigned char level;
+    unsigned long us;
+
+    if (left > MAX_CHUNK) {
+        OCR1B += MAX_CHUNK;
+        left -= MAX_CHUNK;
+        return;
+    }
+    OCR1B += left;
 
-  digitalWrite(pin, LOW);
-  for (i = 0; i != 2; i++) {
-    delayMicroseconds(15000);
-  }
-  delayMicroseconds(400);
+    if (next_pulse(&level, &us)) {
+        left = us * TICKS_PER_US;
+        set_on_compare(level);
+    } else {
+        left = 0;
+        set_on_compare(0);
+        ending = 1;
+    }
 }
 
-void srts_transmit(int pin, unsigned char key, unsigned short address,
-        unsigned char command, unsigned short code, int repeated) {
-    struct srts_payload payload;
+ISR(TIMER1_COMPB_vect) {
+    unsigned int behind = TCNT1 - OCR1B;
 
-    pinMode(pin, OUTPUT);
-    sync_transmit(pin, repeated);
+    if (behind > late) {
+        late = behind;
+    }
 
-    digitalWrite(pin, HIGH);
-    delayMicroseconds(4800);
-    digitalWrite(pin, LOW);
-    delayMicroseconds(660);
+    if (ending) {
+        TIMSK1 &= ~_BV(OCIE1B);
+        done = 1;
+        return;
+    }
+    program();
+}
+
+static void start_train(void) {
+    unsigned char level;
+    unsigned long us;
 
-    payload.key = key;
-    payload.ctrl = command;
-    payload.checksum = 0;
-    payload.code = code;
-    payload.address.byte1 = ((char *) &address)[0];
-    payload.address.byte2 = ((char *) &address)[1];
-    payload.address.byte3 = 0;
+    frame = section = rep = element = 0;
+    late = 0;
+    ending = done = 0;
+    next_pulse(&level, &us);
 
-    checksum_payload(&payload);
-    obfuscate_payload(&payload);
+    noInterrupts();
+    /* force the first level now, then let the compares do the rest */
+    set_on_compare(level);
+    TCCR1C = _BV(FOC1B);
+    left = us * TICKS_PER_US;
+    OCR1B = TCNT1;
+    program();
+    TIFR1 = _BV(OCF1B);
+    TIMSK1 |= _BV(OCIE1B);
+    interrupts();
 
-    write_payload(pin, &payload);
-    write_interval_gap(pin);
+    started = micros();
 }
 
+static void handle_command(const unsigned char *buffer) {
+    unsigned char seq = buffer[3];
+    unsigned long address;
 
-int pin = 10;
+    if (buffer[SERIAL_COMMAND_SIZE - 1] !=
+            crc8(buffer, SERIAL_COMMAND_SIZE - 1)) {
+        send_ack(seq, SERIAL_BAD_CRC, 0, 0, 0);
+        return;
+    }
+
+    /* sent again, its ack got lost, never transmit a train twice */
+    if (has_last && seq == last_seq) {
+        if (busy) {
+            send_ack(seq, SERIAL_ACCEPTED, 0, 0, 0);
+        } else {
+            send_ack(seq, SERIAL_DONE, last_frames, airtime,
+                    late / TICKS_PER_US);
+        }
+        return;
+    }
+
+    if (busy || buffer[1] >= PROTOCOL_COUNT || buffer[13] == 0) {
+        send_ack(seq, SERIAL_BAD_COMMAND, 0, 0, 0);
+        return;
+    }
+
+    address = buffer[4] | (unsigned long) buffer[5] << 8 |
+        (unsigned long) buffer[6] << 16 | (unsigned long) buffer[7] << 24;
+    if (buffer[1] == PROTOCOL_SRTS) {
+        srts_bits(address, buffer[8], buffer[9], buffer[11] | buffer[12] << 8);
+    } else {
+        homeasy_bits(address, buffer[8], buffer[10],
+                buffer[2] & SERIAL_GROUP);
+    }
+    protocol = &protocols[buffer[1]];
+    repeated = buffer[2] & SERIAL_REPEATED;
+    frames = buffer[13];
+
+    last_seq = seq;
+    has_last = 1;
+    busy = 1;
+
+    start_train();
+    send_ack(seq, SERIAL_ACCEPTED, 0, 0, 0);
+}
 
 void setup(void) {
-  Serial.begin(9600);
+    pinMode(pin, OUTPUT);
+    digitalWrite(pin, LOW);
+
+    /* normal mode, prescaler 8 */
+    TCCR1A = 0;
+    TCCR1B = _BV(CS11);
+    TIMSK1 = 0;
 
-  randomSeed(analogRead(0));
+    Serial.begin(115200);
+    send_ack(0, SERIAL_READY, 0, 0, 0);
 }
 
 void loop(void) {
-  long key;
-  int i;
+    static unsigned char buffer[SERIAL_COMMAND_SIZE];
+    static unsigned char len = 0;
+    int c;
 
-  key = random(255);
+    if (busy && done) {
+        airtime = micros() - started;
+        last_frames = frames;
+        busy = 0;
 
-  srts_transmit(pin, key, 3333, DOWN, 34, 0);
+        /* back to a plain low output */
+        TCCR1A &= ~(_BV(COM1B1) | _BV(COM1B0));
+        digitalWrite(pin, LOW);
 
-  for (i = 0; i != 7; i++) {
-    srts_transmit(pin, key, 3333, DOWN, 34, 1);
-  }
+        send_ack(last_seq, SERIAL_DONE, last_frames, airtime,
+                late / TICKS_PER_US);
+    }
+
+    while ((c = Serial.read()) != -1) {
+        if (len == 0 && c != SERIAL_COMMAND_MAGIC) {
+            continue;
+        }
+        buffer[len++] = c;
+        if (len == SERIAL_COMMAND_SIZE) {
+            len = 0;
+            handle_command(buffer);
+        }
+    }
 }
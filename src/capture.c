@@ -0,0 +1,279 @@
+/*
+ * Copyright (C) 2014 Sylvain Afchain
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "capture.h"
+#include "trace.h"
+
+static struct capture_chunk *chunk_at(unsigned char *map, unsigned int i) {
+    return (struct capture_chunk *) (map + CAPTURE_HEADER_SIZE +
+            (unsigned long long) i * CAPTURE_CHUNK_SIZE);
+}
+
+static int chunk_valid(struct capture_chunk *chunk) {
+    return le32toh(chunk->magic) == CAPTURE_CHUNK_MAGIC &&
+        le32toh(chunk->used) <= CAPTURE_DATA;
+}
+
+static int header_valid(struct capture_header *header, unsigned int chunks) {
+    return memcmp(header->magic, CAPTURE_MAGIC, sizeof(header->magic)) == 0 &&
+        le32toh(header->version) == CAPTURE_VERSION &&
+        le32toh(header->chunk_size) == CAPTURE_CHUNK_SIZE &&
+        le32toh(header->chunks) == chunks;
+}
+
+/*
+ * A file of the same size is carried on after its newest chunk, the history
+ * survives restarts, anything else is started over.
+ */
+int capture_open(struct capture *capture, const char *path,
+        unsigned int size_mb) {
+    struct capture_header *header;
+    struct capture_chunk *chunk;
+    struct stat st;
+    unsigned int i;
+    int found = 0;
+
+    memset(capture, 0, sizeof(struct capture));
+    capture->chunks = (unsigned long long) size_mb * 1024 * 1024 /
+        CAPTURE_CHUNK_SIZE;
+    capture->length = CAPTURE_HEADER_SIZE +
+        (unsigned long long) capture->chunks * CAPTURE_CHUNK_SIZE;
+    if (capture->chunks < 2) {
+        fprintf(stderr, "Capture ring too small: %u MB\n", size_mb);
+        return -1;
+    }
+
+    if ((capture->fd = open(path, O_RDWR | O_CREAT, 0644)) == -1) {
+        perror(path);
+        return -1;
+    }
+    if (fstat(capture->fd, &st) == -1 ||
+            ((unsigned long long) st.st_size != capture->length &&
+             ftruncate(capture->fd, capture->length) == -1)) {
+        perror(path);
+        close(capture->fd);
+        return -1;
+    }
+
+    capture->map = (unsigned char *) mmap(NULL, capture->length,
+            PROT_READ | PROT_WRITE, MAP_SHARED, capture->fd, 0);
+    if (capture->map == MAP_FAILED) {
+        perror("mmap");
+        close(capture->fd);
+        return -1;
+    }
+
+    header = (struct capture_header *) capture->map;
+    if ((unsigned long long) st.st_size == capture->length &&
+            header_valid(header, capture->chunks)) {
+        for (i = 0; i != capture->chunks; i++) {
+            chunk = chunk_at(capture->map, i);
+            if (chunk_valid(chunk) && (! found ||
+                        le32toh(chunk->seq) - capture->seq < 0x80000000U)) {
+                capture->seq = le32toh(chunk->seq);
+                found = 1;
+            }
+        }
+        capture->seq += found;
+    } else {
+        memset(capture->map, 0, CAPTURE_HEADER_SIZE);
+        memcpy(header->magic, CAPTURE_MAGIC, sizeof(header->magic));
+        header->version = htole32(CAPTURE_VERSION);
+        header->chunk_size = htole32(CAPTURE_CHUNK_SIZE);
+        header->chunks = htole32(capture->chunks);
+        for (i = 0; i != capture->chunks; i++) {
+            chunk_at(capture->map, i)->magic = 0;
+        }
+    }
+
+    return 0;
+}
+
+void capture_close(struct capture *capture) {
+    msync(capture->map, capture->length, MS_SYNC);
+    munmap(capture->map, capture->length);
+    close(capture->fd);
+}
+
+static unsigned long long clock_us(clockid_t clock) {
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+/*
+ * Once per chunk: the 32 bits timestamp of the pulse, the end of it on the
+ * clock of signal_eventd, is widened with the clock read now.
+ */
+struct capture_chunk *capture_next_chunk(struct capture *capture,
+        unsigned int duration, unsigned int timestamp) {
+    struct capture_chunk *chunk;
+    unsigned long long now, wall, start;
+
+    now = clock_us(CLOCK_MONOTONIC);
+    wall = clock_us(CLOCK_REALTIME);
+    start = now - (unsigned int) ((unsigned int) now - timestamp) - duration;
+
+    chunk = chunk_at(capture->map, capture->seq % capture->chunks);
+
+    /* invalid while being rewritten */
+    __atomic_store_n(&chunk->magic, 0, __ATOMIC_RELEASE);
+    chunk->seq = htole32(capture->seq);
+    chunk->start_us = htole64(start);
+    chunk->wall_us = htole64(wall - (now - start));
+    chunk->count = 0;
+    chunk->used = 0;
+    __atomic_store_n(&chunk->magic, htole32(CAPTURE_CHUNK_MAGIC),
+            __ATOMIC_RELEASE);
+
+    capture->seq++;
+    capture->chunk = chunk;
+
+    return chunk;
+}
+
+static const unsigned char *chunk_seq_base;
+
+static int compare_seq(const void *a, const void *b) {
+    unsigned int seq_a, seq_b;
+
+    seq_a = le32toh(chunk_at((unsigned char *) chunk_seq_base,
+                *(const unsigned int *) a)->seq);
+    seq_b = le32toh(chunk_at((unsigned char *) chunk_seq_base,
+                *(const unsigned int *) b)->seq);
+
+    /* serial number order, as capture_open, the sequence wraps */
+    return (int) (seq_a - seq_b);
+}
+
+static void print_wall(FILE *fp, unsigned long long wall_us) {
+    time_t seconds = wall_us / 1000000;
+    char buffer[32];
+    struct tm tm;
+
+    localtime_r(&seconds, &tm);
+    strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", &tm);
+    fprintf(fp, "%s.%06llu", buffer, wall_us % 1000000);
+}
+
+/*
+ * The pulses ending between from_us and to_us, wall clock, oldest first, to
+ * an edge trace. With list set, only the span of the ring is printed there.
+ * Returns the number of pulses, -1 on error.
+ */
+int capture_extract(const char *path, unsigned long long from_us,
+        unsigned long long to_us, FILE *trace, FILE *list) {
+    unsigned long long wall_end, first = 0, last = 0;
+    struct capture_header *header;
+    struct capture_chunk *chunk;
+    unsigned int *order, chunks, count = 0, value, shift, i;
+    const unsigned char *p, *data_end;
+    unsigned char *map;
+    struct stat st;
+    int fd, pulses = 0;
+
+    if ((fd = open(path, O_RDONLY)) == -1 || fstat(fd, &st) == -1) {
+        perror(path);
+        return -1;
+    }
+    if (st.st_size < CAPTURE_HEADER_SIZE) {
+        fprintf(stderr, "Not a capture file: %s\n", path);
+        close(fd);
+        return -1;
+    }
+    map = (unsigned char *) mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd,
+            0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        return -1;
+    }
+
+    header = (struct capture_header *) map;
+    chunks = (st.st_size - CAPTURE_HEADER_SIZE) / CAPTURE_CHUNK_SIZE;
+    if (! header_valid(header, chunks)) {
+        fprintf(stderr, "Not a capture file: %s\n", path);
+        munmap(map, st.st_size);
+        return -1;
+    }
+
+    if ((order = (unsigned int *) malloc(chunks * sizeof(unsigned int))) ==
+            NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        exit(-1);
+    }
+    for (i = 0; i != chunks; i++) {
+        if (chunk_valid(chunk_at(map, i))) {
+            order[count++] = i;
+        }
+    }
+    chunk_seq_base = map;
+    qsort(order, count, sizeof(unsigned int), compare_seq);
+
+    for (i = 0; i != count && pulses != -1; i++) {
+        chunk = chunk_at(map, order[i]);
+        wall_end = le64toh(chunk->wall_us);
+        if (i == 0) {
+            first = wall_end;
+        }
+
+        p = chunk->data;
+        data_end = p + le32toh(__atomic_load_n(&chunk->used, __ATOMIC_ACQUIRE));
+        while (p != data_end) {
+            value = 0;
+            for (shift = 0; p != data_end && shift < 35; shift += 7) {
+                value |= (*p & 0x7f) << shift;
+                if (! (*p++ & 0x80)) {
+                    break;
+                }
+            }
+            wall_end += value >> 1;
+
+            if (list == NULL && wall_end >= from_us && wall_end <= to_us) {
+                if (trace_write(trace, value & 1, value >> 1) == -1) {
+                    pulses = -1;
+                    break;
+                }
+                pulses++;
+            }
+        }
+        last = wall_end;
+    }
+
+    if (list != NULL && count) {
+        fprintf(list, "%u chunks of %u, from ", count, chunks);
+        print_wall(list, first);
+        fprintf(list, " to ");
+        print_wall(list, last);
+        fprintf(list, "\n");
+    }
+
+    free(order);
+    munmap(map, st.st_size);
+
+    return pulses;
+}
@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2014 Sylvain Afchain
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef __CAPTURE_H__
+#define __CAPTURE_H__
+
+#include <stdio.h>
+#include <endian.h>
+
+/*
+ * Ring file of every edge received, kept for post-mortem replay. The file is
+ * a header page followed by fixed size chunks used round robin, the oldest
+ * chunk overwritten once the ring is full. A chunk starts with the absolute
+ * time of its first pulse, on the monotonic and on the wall clock, followed
+ * by its pulses, duration << 1 | level as LEB128 varints, so a chunk decodes
+ * on its own whatever was overwritten before it. Every field is little
+ * endian.
+ *
+ * The file is mapped, adding an edge is a few stores to memory, the kernel
+ * writes the pages back at its own pace, sequentially, which is gentle on SD
+ * cards.
+ */
+#define CAPTURE_MAGIC "EDGERING"
+#define CAPTURE_VERSION 1
+#define CAPTURE_CHUNK_MAGIC 0x4b4e4843
+
+#define CAPTURE_HEADER_SIZE 4096
+#define CAPTURE_CHUNK_SIZE 4096
+#define CAPTURE_CHUNK_HEADER 32
+#define CAPTURE_DATA (CAPTURE_CHUNK_SIZE - CAPTURE_CHUNK_HEADER)
+
+/* a pulse never takes more than this in a chunk */
+#define CAPTURE_RECORD_MAX 5
+
+/* mega bytes, hours of a busy band */
+#define CAPTURE_DEFAULT_SIZE 64
+/* mega bytes, the whole ring is mapped in the 32 bits address space of a Pi */
+#define CAPTURE_MAX_SIZE 512
+
+struct capture_header {
+    char magic[8];
+    unsigned int version;
+    unsigned int chunk_size;
+    unsigned int chunks;
+};
+
+struct capture_chunk {
+    unsigned int magic;
+    unsigned int seq;
+    /* micro seconds, the start of the first pulse */
+    unsigned long long start_us;
+    unsigned long long wall_us;
+    unsigned int count;
+    unsigned int used;
+    unsigned char data[CAPTURE_DATA];
+};
+
+struct capture {
+    int fd;
+    unsigned char *map;
+    unsigned long long length;
+    unsigned int chunks;
+
+    /* NULL until the first pulse */
+    struct capture_chunk *chunk;
+    unsigned int seq;
+};
+
+int capture_open(struct capture *capture, const char *path,
+        unsigned int size_mb);
+void capture_close(struct capture *capture);
+struct capture_chunk *capture_next_chunk(struct capture *capture,
+        unsigned int duration, unsigned int timestamp);
+int capture_extract(const char *path, unsigned long long from_us,
+        unsigned long long to_us, FILE *trace, FILE *list);
+
+/*
+ * Runs for every edge on the decoder thread, no syscall, no lock, the
+ * timestamp is only looked at when a chunk starts.
+ */
+static inline void capture_edge(struct capture *capture, unsigned int type,
+        unsigned int duration, unsigned int timestamp) {
+    struct capture_chunk *chunk = capture->chunk;
+    unsigned int value, used;
+    unsigned char *p;
+
+    if (chunk == NULL ||
+            le32toh(chunk->used) > CAPTURE_DATA - CAPTURE_RECORD_MAX) {
+        chunk = capture_next_chunk(capture, duration, timestamp);
+    }
+
+    used = le32toh(chunk->used);
+    p = chunk->data + used;
+    value = (duration & 0x7fffffff) << 1 | (type & 1);
+    while (value >= 0x80) {
+        *p++ = value | 0x80;
+        value >>= 7;
+    }
+    *p++ = value;
+
+    chunk->count = htole32(le32toh(chunk->count) + 1);
+    /* a reader of the live file never sees a record half written */
+    __atomic_store_n(&chunk->used, htole32(p - chunk->data), __ATOMIC_RELEASE);
+}
+
+#endif
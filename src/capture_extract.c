@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2014 Sylvain Afchain
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+
+#include "capture.h"
+#include "trace.h"
+
+static void usage(char *name) {
+    printf("Usage: %s [--from <time>] [--to <time>] <capture file> <trace file>\n"
+            "       %s --list <capture file>\n"
+            "time: [YYYY-MM-DD ]HH:MM[:SS] local time, the latest one when "
+            "without a date, or @<seconds since the epoch>\n", name, name);
+    exit(-1);
+}
+
+/* wall clock micro seconds, 0 on error */
+static unsigned long long parse_time(const char *spec) {
+    static const char *formats[] = { "%Y-%m-%d %H:%M:%S", "%Y-%m-%d %H:%M",
+        "%H:%M:%S", "%H:%M" };
+    struct tm tm, today;
+    time_t now, seconds;
+    const char *end;
+    long int a2i;
+    char *a2i_end;
+    unsigned int i;
+
+    if (spec[0] == '@') {
+        a2i = strtol(spec + 1, &a2i_end, 10);
+        if (*a2i_end != '\0' || a2i_end == spec + 1 || a2i <= 0) {
+            return 0;
+        }
+        return a2i * 1000000ULL;
+    }
+
+    now = time(NULL);
+    for (i = 0; i != sizeof(formats) / sizeof(formats[0]); i++) {
+        localtime_r(&now, &today);
+        tm = today;
+        tm.tm_sec = 0;
+        if ((end = strptime(spec, formats[i], &tm)) == NULL || *end != '\0') {
+            continue;
+        }
+        tm.tm_isdst = -1;
+        seconds = mktime(&tm);
+
+        /* a time of day not reached yet today was yesterday */
+        if (i >= 2 && seconds > now) {
+            tm = today;
+            tm.tm_mday--;
+            strptime(spec, formats[i], &tm);
+            tm.tm_isdst = -1;
+            seconds = mktime(&tm);
+        }
+
+        return seconds * 1000000ULL;
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    struct option long_options[] = { { "from", 1, 0, 0 },
+        { "to", 1, 0, 0 }, { "list", 0, 0, 0 }, { NULL, 0, 0, 0 } };
+    unsigned long long from = 0, to = ULLONG_MAX;
+    FILE *trace;
+    int list = 0, pulses, i, c;
+
+    while (1) {
+        c = getopt_long(argc, argv, "", long_options, &i);
+        if (c == -1)
+            break;
+        switch (c) {
+            case 0:
+                if (strcmp(long_options[i].name, "from") == 0) {
+                    if ((from = parse_time(optarg)) == 0) {
+                        usage(argv[0]);
+                    }
+                } else if (strcmp(long_options[i].name, "to") == 0) {
+                    if ((to = parse_time(optarg)) == 0) {
+                        usage(argv[0]);
+                    }
+                } else if (strcmp(long_options[i].name, "list") == 0) {
+                    list = 1;
+                }
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    if (list) {
+        if (optind != argc - 1) {
+            usage(argv[0]);
+        }
+        return capture_extract(argv[optind], 0, 0, NULL, stdout) == -1 ? -1 : 0;
+    }
+
+    if (optind != argc - 2 || from > to) {
+        usage(argv[0]);
+    }
+
+    if ((trace = trace_create(argv[optind + 1])) == NULL) {
+        fprintf(stderr, "Unable to create the trace file: %s\n",
+                argv[optind + 1]);
+        return -1;
+    }
+    pulses = capture_extract(argv[optind], from, to, trace, NULL);
+    if (fclose(trace) != 0 || pulses == -1) {
+        return -1;
+    }
+    printf("%d edges extracted\n", pulses);
+
+    return 0;
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2014 Sylvain Afchain
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "client.h"
+
+/*
+ * Send the request lines to the daemon and wait for all the replies. Returns
+ * -1 without side effect when the daemon is not running.
+ */
+int client_request(const char *path, const char *request, char *reply,
+        int size) {
+    struct sockaddr_un addr;
+    int fd, len, rtv;
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
+        close(fd);
+        return -1;
+    }
+
+    len = strlen(request);
+    while (len > 0) {
+        if ((rtv = write(fd, request, len)) <= 0) {
+            close(fd);
+            return -1;
+        }
+        request += rtv;
+        len -= rtv;
+    }
+    shutdown(fd, SHUT_WR);
+
+    len = 0;
+    while (len < size - 1 && (rtv = read(fd, reply + len, size - 1 - len)) > 0) {
+        len += rtv;
+    }
+    reply[len] = '\0';
+
+    close(fd);
+
+    return 0;
+}
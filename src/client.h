@@ -0,0 +1,36 @@
+/*
+ * Copyright (C) 2014 Sylvain Afchain
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef __CLIENT_H__
+#define __CLIENT_H__
+
+#define DOMIOTOOLSD_SOCKET "/var/run/domiotoolsd.sock"
+#define DOMIOTOOLSD_STATS "/var/run/domiotoolsd.stats"
+
+/*
+ * Requests are text lines, "srts <gpio> <address> <command>",
+ * "srts-group <gpio> <address>:<command>..." or
+ * "homeasy <gpio> <address> <receiver>[:<command>][,...]|all <command> <retry>".
+ * Each line is answered once transmitted by "ok <elapsed us>" or
+ * "error <reason>".
+ */
+#define CLIENT_LINE_MAX 1024
+#define CLIENT_BATCH_MAX 64
+
+int client_request(const char *path, const char *request, char *reply,
+        int size);
+
+#endif
@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2014 Sylvain Afchain
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <string.h>
+
+#include "dedupe.h"
+#include "telemetry.h"
+
+/* everything telling two logical commands apart, repeats share it */
+unsigned long long dedupe_key(struct frame *frame) {
+    unsigned long long key = (unsigned long long) frame->protocol << 56;
+    struct srts_payload *payload;
+    struct homeasy_frame *homeasy;
+
+    switch (frame->protocol) {
+        case PROTOCOL_SRTS:
+            payload = &frame->srts;
+            key |= (unsigned long long) payload->address.byte3 << 40 |
+                (unsigned long long) payload->address.byte2 << 32 |
+                (unsigned long long) payload->address.byte1 << 24 |
+                payload->code << 8 | payload->ctrl;
+            break;
+        case PROTOCOL_HOMEASY:
+            homeasy = &frame->homeasy;
+            key |= (unsigned long long) homeasy->address << 8 |
+                homeasy->receiver << 2 | homeasy->group << 1 |
+                homeasy->command;
+            break;
+    }
+
+    return key;
+}
+
+unsigned int dedupe_set(unsigned long long key) {
+    return (key * 0x9e3779b97f4a7c15ULL) >> 58 & (DEDUPE_SETS - 1);
+}
+
+/*
+ * The slot of the command in its set, else a free one, else the one least
+ * recently repeated, its event goes out early.
+ */
+static struct dedupe_slot *key_slot(struct dedupe *dedupe,
+        unsigned long long key, unsigned int timestamp) {
+    struct dedupe_slot *set, *slot = NULL;
+    int i;
+
+    set = &dedupe->slots[dedupe_set(key) * DEDUPE_WAYS];
+    for (i = 0; i != DEDUPE_WAYS; i++) {
+        if (set[i].used && set[i].key == key) {
+            return &set[i];
+        }
+        if (slot == NULL || (slot->used && (! set[i].used ||
+                        timestamp - set[i].event.last >
+                        timestamp - slot->event.last))) {
+            slot = &set[i];
+        }
+    }
+
+    return slot;
+}
+
+static void emit(struct dedupe *dedupe, struct dedupe_slot *slot) {
+    slot->used = 0;
+    dedupe->used--;
+
+    TELEMETRY_INC(dedupe->events);
+    dedupe->output(&slot->event, dedupe->arg);
+}
+
+void dedupe_init(struct dedupe *dedupe,
+        void (*output)(struct dedupe_event *event, void *arg), void *arg) {
+    int i;
+
+    memset(dedupe, 0, sizeof(struct dedupe));
+    for (i = 0; i != PROTOCOL_COUNT; i++) {
+        dedupe->windows[i] = protocols[i].repeat_window;
+    }
+    dedupe->output = output;
+    dedupe->arg = arg;
+}
+
+void dedupe_set_window(struct dedupe *dedupe, unsigned int window) {
+    int i;
+
+    for (i = 0; i != PROTOCOL_COUNT; i++) {
+        dedupe->windows[i] = window;
+    }
+}
+
+void dedupe_frame(struct dedupe *dedupe, struct frame *frame,
+        unsigned int timestamp) {
+    unsigned long long key = dedupe_key(frame);
+    struct dedupe_slot *slot;
+    struct dedupe_event event;
+
+    TELEMETRY_INC(dedupe->frames);
+
+    if (dedupe->windows[frame->protocol] == 0) {
+        event.frame = *frame;
+        event.repeats = 1;
+        event.first = event.last = timestamp;
+
+        TELEMETRY_INC(dedupe->events);
+        dedupe->output(&event, dedupe->arg);
+        return;
+    }
+
+    slot = key_slot(dedupe, key, timestamp);
+    if (slot->used) {
+        if (slot->key == key && timestamp - slot->event.last <
+                dedupe->windows[frame->protocol]) {
+            slot->event.repeats++;
+            slot->event.last = timestamp;
+            return;
+        }
+
+        /* another command, or the same one sent again later */
+        if (slot->key != key) {
+            TELEMETRY_INC(dedupe->evictions);
+        }
+        emit(dedupe, slot);
+    }
+
+    slot->key = key;
+    slot->used = 1;
+    slot->event.frame = *frame;
+    slot->event.repeats = 1;
+    slot->event.first = slot->event.last = timestamp;
+    dedupe->used++;
+}
+
+/* emits the commands not repeated for their whole window */
+void dedupe_expire(struct dedupe *dedupe, unsigned int now) {
+    struct dedupe_slot *slot;
+    int i;
+
+    for (i = 0; i != DEDUPE_SLOTS && dedupe->used; i++) {
+        slot = &dedupe->slots[i];
+        if (slot->used && now - slot->event.last >=
+                dedupe->windows[slot->event.frame.protocol]) {
+            emit(dedupe, slot);
+        }
+    }
+}
+
+void dedupe_flush(struct dedupe *dedupe) {
+    int i;
+
+    for (i = 0; i != DEDUPE_SLOTS && dedupe->used; i++) {
+        if (dedupe->slots[i].used) {
+            emit(dedupe, &dedupe->slots[i]);
+        }
+    }
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2014 Sylvain Afchain
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef __DEDUPE_H__
+#define __DEDUPE_H__
+
+#include "protocol.h"
+
+/* must be a power of two, far more than the commands in flight at once */
+#define DEDUPE_SLOTS 64
+/* slots a key can take, the oldest command of a full set gives way */
+#define DEDUPE_WAYS 4
+#define DEDUPE_SETS (DEDUPE_SLOTS / DEDUPE_WAYS)
+
+/* one logical command, whatever the number of frames it was sent with */
+struct dedupe_event {
+    struct frame frame;
+    unsigned int repeats;
+
+    /* micro seconds, same clock as the frames */
+    unsigned int first;
+    unsigned int last;
+};
+
+struct dedupe_slot {
+    unsigned long long key;
+    int used;
+    struct dedupe_event event;
+};
+
+/*
+ * Fixed size cache of the commands being repeated, set associative. A frame
+ * is merged into the slot of its command among the few of its set, the event
+ * is emitted once no repeat has been seen for the repeat window of its
+ * protocol, or earlier when its set is full and it is the oldest there.
+ */
+struct dedupe {
+    struct dedupe_slot slots[DEDUPE_SLOTS];
+    unsigned int used;
+
+    /* micro seconds, 0 emits every frame as is */
+    unsigned int windows[PROTOCOL_COUNT];
+
+    void (*output)(struct dedupe_event *event, void *arg);
+    void *arg;
+
+    /* statistics */
+    unsigned long frames;
+    unsigned long events;
+    unsigned long evictions;
+};
+
+void dedupe_init(struct dedupe *dedupe,
+        void (*output)(struct dedupe_event *event, void *arg), void *arg);
+void dedupe_set_window(struct dedupe *dedupe, unsigned int window);
+unsigned long long dedupe_key(struct frame *frame);
+unsigned int dedupe_set(unsigned long long key);
+void dedupe_frame(struct dedupe *dedupe, struct frame *frame,
+        unsigned int timestamp);
+void dedupe_expire(struct dedupe *dedupe, unsigned int now);
+void dedupe_flush(struct dedupe *dedupe);
+
+#endif
@@ -0,0 +1,559 @@
+/*
+ * Copyright (C) 2014 Sylvain Afchain
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#define _GNU_SOURCE
+
+#include <wiringPi.h>
+#include <stdio.h>
+#include <syslog.h>
+#include <getopt.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "common.h"
+#include "srts.h"
+#include "homeasy.h"
+#include "ook_protocols.h"
+#include "rolling_code.h"
+#include "client.h"
+#include "rt.h"
+
+/* the state files of srts_sender to import into the rolling code table */
+#define SRTS_STATE "srts_sender"
+
+enum JOB_PROTOCOL {
+    JOB_SRTS = 0,
+    JOB_SRTS_GROUP,
+    JOB_HOMEASY
+};
+
+struct job {
+    int protocol;
+    int gpio;
+    unsigned int address;
+    unsigned char command;
+    int retry;
+    struct srts_target targets[SRTS_GROUP_MAX];
+    struct homeasy_target receivers[HOMEASY_RECEIVERS];
+    unsigned int count;
+
+    int done;
+    int status;
+    long elapsed;
+    struct job *next;
+};
+
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+static struct job *queue_head = NULL;
+static struct job *queue_tail = NULL;
+
+/* only touched by the transmit thread */
+static struct rolling_code_table codes;
+static struct timeline_stats stats;
+static unsigned long long gpio_configured = 0;
+
+static struct rt_config rt;
+
+static void setup_gpio(int gpio) {
+    if (gpio < 64 && (gpio_configured & (1ULL << gpio))) {
+        return;
+    }
+    pinMode(gpio, OUTPUT);
+    if (gpio < 64) {
+        gpio_configured |= 1ULL << gpio;
+    }
+}
+
+static void run_group(struct job *job, struct timeline *timeline) {
+    unsigned short addresses[SRTS_GROUP_MAX], codes_reserved[SRTS_GROUP_MAX];
+    unsigned int i;
+
+    for (i = 0; i != job->count; i++) {
+        addresses[i] = job->targets[i].address;
+    }
+    rolling_code_reserve_group(&codes, addresses, codes_reserved, job->count);
+
+    for (i = 0; i != job->count; i++) {
+        job->targets[i].key = rand() % 255;
+        job->targets[i].code = codes_reserved[i];
+        syslog(LOG_INFO, "remote: %d, command: %d, code: %d\n",
+               job->targets[i].address, job->targets[i].command,
+               job->targets[i].code);
+    }
+
+    srts_compile_group(timeline, job->targets, job->count);
+    timeline_play(timeline, job->gpio, digitalWrite, &stats);
+}
+
+static void run_job(struct job *job, struct timeline *timeline) {
+    struct srts_target target;
+    unsigned short code;
+    unsigned char key;
+    unsigned int i;
+
+    setup_gpio(job->gpio);
+    timeline_clear(timeline);
+
+    if (job->protocol == JOB_SRTS) {
+        key = rand() % 255;
+        code = rolling_code_reserve(&codes, job->address);
+
+        syslog(LOG_INFO, "remote: %d, command: %d, code: %d\n", job->address,
+               job->command, code);
+
+        target.address = job->address;
+        target.command = job->command;
+        target.key = key;
+        target.code = code;
+        srts_compile_group(timeline, &target, 1);
+        timeline_play(timeline, job->gpio, digitalWrite, &stats);
+    } else if (job->protocol == JOB_SRTS_GROUP) {
+        run_group(job, timeline);
+    } else {
+        for (i = 0; i != job->count; i++) {
+            syslog(LOG_INFO, "remote: %d, receiver, %d, command: %d\n",
+                   job->address, job->receivers[i].receiver,
+                   job->receivers[i].command);
+        }
+
+        homeasy_compile_group(timeline, job->address, job->receivers,
+                job->count, job->retry);
+        timeline_play(timeline, job->gpio, digitalWrite, &stats);
+    }
+
+    job->status = 0;
+}
+
+/* replaced at once, readers never see a partial file */
+static void write_stats() {
+    char path[] = DOMIOTOOLSD_STATS ".tmp";
+    FILE *fp;
+
+    if ((fp = fopen(path, "w")) == NULL) {
+        return;
+    }
+    timeline_stats_print(&stats, fp);
+    if (fclose(fp) == 0) {
+        rename(path, DOMIOTOOLSD_STATS);
+    }
+}
+
+static void *transmit_thread(void *arg) {
+    struct timespec start, end;
+    struct timeline timeline;
+    struct job *job;
+
+    rt_apply(&rt, RT_TRANSMIT);
+    timeline_init(&timeline);
+    timeline_stats_init(&stats);
+
+    while (1) {
+        pthread_mutex_lock(&queue_lock);
+        if (queue_head == NULL) {
+            /* the queue drained, write back the codes reserved meanwhile */
+            pthread_mutex_unlock(&queue_lock);
+            rolling_code_flush(&codes);
+            pthread_mutex_lock(&queue_lock);
+        }
+        while (queue_head == NULL) {
+            pthread_cond_wait(&queue_cond, &queue_lock);
+        }
+        job = queue_head;
+        queue_head = job->next;
+        if (queue_head == NULL) {
+            queue_tail = NULL;
+        }
+        pthread_mutex_unlock(&queue_lock);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        run_job(job, &timeline);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        write_stats();
+
+        pthread_mutex_lock(&queue_lock);
+        job->elapsed = (end.tv_sec - start.tv_sec) * 1000000 +
+                (end.tv_nsec - start.tv_nsec) / 1000;
+        job->done = 1;
+        pthread_cond_broadcast(&done_cond);
+        pthread_mutex_unlock(&queue_lock);
+    }
+
+    return NULL;
+}
+
+static int parse_int(char *token, long int *value) {
+    char *end;
+
+    if (token == NULL) {
+        return -1;
+    }
+
+    errno = 0;
+    *value = strtol(token, &end, 10);
+    if (errno != 0 || *end != '\0' || end == token) {
+        return -1;
+    }
+
+    return 0;
+}
+
+static int parse_job(char *line, struct job *job) {
+    char *token, *saveptr, *receivers = NULL;
+    int count;
+    long int a2i;
+
+    memset(job, 0, sizeof(struct job));
+    job->status = -1;
+
+    if ((token = strtok_r(line, " \t\r", &saveptr)) == NULL) {
+        return -1;
+    }
+    if (strcmp(token, "srts") == 0) {
+        job->protocol = JOB_SRTS;
+    } else if (strcmp(token, "srts-group") == 0) {
+        job->protocol = JOB_SRTS_GROUP;
+    } else if (strcmp(token, "homeasy") == 0) {
+        job->protocol = JOB_HOMEASY;
+    } else {
+        return -1;
+    }
+
+    if (parse_int(strtok_r(NULL, " \t\r", &saveptr), &a2i) == -1 || a2i < 0) {
+        return -1;
+    }
+    job->gpio = a2i;
+
+    if (job->protocol == JOB_SRTS_GROUP) {
+        while ((token = strtok_r(NULL, " \t\r", &saveptr)) != NULL) {
+            if (job->count == SRTS_GROUP_MAX ||
+                    srts_target(token, &job->targets[job->count]) == -1) {
+                return -1;
+            }
+            job->count++;
+        }
+
+        return job->count ? 0 : -1;
+    }
+
+    if (parse_int(strtok_r(NULL, " \t\r", &saveptr), &a2i) == -1 || a2i <= 0) {
+        return -1;
+    }
+    job->address = a2i;
+
+    if (job->protocol == JOB_HOMEASY) {
+        if ((receivers = strtok_r(NULL, " \t\r", &saveptr)) == NULL) {
+            return -1;
+        }
+    }
+
+    if ((token = strtok_r(NULL, " \t\r", &saveptr)) == NULL) {
+        return -1;
+    }
+    if (job->protocol == JOB_SRTS) {
+        if (job->address > 0xffff ||
+                (job->command = srts_command(token)) == UNKNOWN) {
+            return -1;
+        }
+    } else {
+        if (job->address > HOMEASY_ADDRESS_MAX ||
+                (job->command = homeasy_command(token)) == HOMEASY_UNKNOWN) {
+            return -1;
+        }
+        if ((count = homeasy_targets(receivers, job->command,
+                        job->receivers)) == -1) {
+            return -1;
+        }
+        job->count = count;
+
+        job->retry = 5;
+        if ((token = strtok_r(NULL, " \t\r", &saveptr)) != NULL) {
+            if (parse_int(token, &a2i) == -1 || a2i <= 0) {
+                return -1;
+            }
+            job->retry = a2i;
+        }
+    }
+
+    return 0;
+}
+
+static int write_all(int fd, const char *buffer, int len) {
+    int rtv;
+
+    while (len > 0) {
+        if ((rtv = write(fd, buffer, len)) <= 0) {
+            return -1;
+        }
+        buffer += rtv;
+        len -= rtv;
+    }
+
+    return 0;
+}
+
+/*
+ * Every complete line read in one go is queued at once, so a batch keeps the
+ * transmitter busy, then the replies are sent back in the request order.
+ * Returns the number of bytes consumed.
+ */
+static int handle_lines(int fd, char *buffer, int len) {
+    struct job *batch[CLIENT_BATCH_MAX], *first = NULL, *tail = NULL;
+    char reply[CLIENT_LINE_MAX], *line, *nl;
+    int count = 0, i, rtv = 0;
+
+    line = buffer;
+    while (count != CLIENT_BATCH_MAX &&
+            (nl = memchr(line, '\n', len - (line - buffer))) != NULL) {
+        *nl = '\0';
+
+        if ((batch[count] = (struct job *) malloc(sizeof(struct job))) == NULL) {
+            fprintf(stderr, "Memory allocation error\n");
+            exit(-1);
+        }
+        if (parse_job(line, batch[count]) == -1) {
+            batch[count]->done = 1;
+        } else {
+            if (first == NULL) {
+                first = batch[count];
+            } else {
+                tail->next = batch[count];
+            }
+            tail = batch[count];
+        }
+        count++;
+        line = nl + 1;
+    }
+
+    pthread_mutex_lock(&queue_lock);
+    if (first != NULL) {
+        if (queue_tail == NULL) {
+            queue_head = first;
+        } else {
+            queue_tail->next = first;
+        }
+        queue_tail = tail;
+        pthread_cond_signal(&queue_cond);
+    }
+    pthread_mutex_unlock(&queue_lock);
+
+    for (i = 0; i != count; i++) {
+        pthread_mutex_lock(&queue_lock);
+        while (! batch[i]->done) {
+            pthread_cond_wait(&done_cond, &queue_lock);
+        }
+        pthread_mutex_unlock(&queue_lock);
+
+        if (batch[i]->status == 0) {
+            snprintf(reply, sizeof(reply), "ok %ld\n", batch[i]->elapsed);
+        } else {
+            snprintf(reply, sizeof(reply), "error invalid request\n");
+        }
+        if (rtv != -1 && write_all(fd, reply, strlen(reply)) == -1) {
+            rtv = -1;
+        }
+        free(batch[i]);
+    }
+
+    if (rtv == -1) {
+        return -1;
+    }
+
+    return line - buffer;
+}
+
+static void *client_thread(void *arg) {
+    int fd = (intptr_t) arg;
+    char buffer[CLIENT_LINE_MAX * CLIENT_BATCH_MAX];
+    int len = 0, rtv;
+
+    while ((rtv = read(fd, buffer + len, sizeof(buffer) - len)) > 0) {
+        len += rtv;
+
+        /*
+         * A batch is bounded, every complete line is answered before reading
+         * again, a pipelining client may be waiting for its replies.
+         */
+        while ((rtv = handle_lines(fd, buffer, len)) > 0) {
+            memmove(buffer, buffer + rtv, len - rtv);
+            len -= rtv;
+        }
+        if (rtv == -1) {
+            break;
+        }
+
+        /* line too long to ever be complete */
+        if (len == sizeof(buffer)) {
+            break;
+        }
+    }
+
+    close(fd);
+
+    return NULL;
+}
+
+static int listen_socket(const char *path) {
+    struct sockaddr_un addr;
+    int fd;
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    unlink(path);
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1 ||
+            chmod(path, 0660) == -1 || listen(fd, 16) == -1) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static void usage(char *name) {
+    printf("Usage: %s [--socket <path>] [--spin-us <us>] [--rt <spec>]... "
+            "[--latency-test <seconds>]\n", name);
+    rt_usage(stdout);
+    exit(-1);
+}
+
+int main(int argc, char **argv) {
+    struct option long_options[] = { { "socket", 1, 0, 0 },
+        { "spin-us", 1, 0, 0 }, { "rt", 1, 0, 0 },
+        { "latency-test", 1, 0, 0 }, { NULL, 0, 0, 0 } };
+    const char *path = DOMIOTOOLSD_SOCKET;
+    pthread_attr_t attr;
+    pthread_t thread;
+    long int a2i, latency_test = 0;
+    int fd, client, i, c;
+    char *end;
+
+    rt_init(&rt);
+
+    while (1) {
+        c = getopt_long(argc, argv, "", long_options, &i);
+        if (c == -1)
+            break;
+        switch (c) {
+            case 0:
+                if (strcmp(long_options[i].name, "socket") == 0) {
+                    path = optarg;
+                } else if (strcmp(long_options[i].name, "spin-us") == 0) {
+                    a2i = strtol(optarg, &end, 10);
+                    if (errno == ERANGE && (a2i == LONG_MAX || a2i == LONG_MIN)) {
+                        break;
+                    }
+                    if (a2i < 0) {
+                        usage(argv[0]);
+                    }
+                    timeline_set_spin(a2i);
+                } else if (strcmp(long_options[i].name, "rt") == 0) {
+                    if (rt_parse(&rt, optarg) == -1) {
+                        usage(argv[0]);
+                    }
+                } else if (strcmp(long_options[i].name, "latency-test") == 0) {
+                    a2i = strtol(optarg, &end, 10);
+                    if (errno == ERANGE && (a2i == LONG_MAX || a2i == LONG_MIN)) {
+                        break;
+                    }
+                    if (a2i <= 0) {
+                        usage(argv[0]);
+                    }
+                    latency_test = a2i;
+                }
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    if (setuid(0)) {
+        perror("setuid");
+        return -1;
+    }
+
+    /* the transmitter is the one waking up to a deadline */
+    if (latency_test) {
+        rt_lock_memory(&rt);
+        return rt_latency_test(&rt, RT_TRANSMIT, latency_test, stdout) == -1 ?
+            -1 : 0;
+    }
+
+    // store pid and lock it
+    store_pid();
+
+    srand(time(NULL));
+
+    if (rolling_code_open(&codes, ROLLING_CODE_TABLE, SRTS_STATE,
+            ROLLING_CODE_SYNC_LAZY) == -1) {
+        return -1;
+    }
+
+    if (wiringPiSetup() == -1) {
+        fprintf(stderr, "Wiring Pi not installed");
+        return -1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    openlog("domiotoolsd", LOG_PID | LOG_CONS, LOG_USER);
+
+    if ((fd = listen_socket(path)) == -1) {
+        fprintf(stderr, "Unable to listen on %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    rt_lock_memory(&rt);
+    if (rt_thread_create(&thread, transmit_thread, NULL) != 0) {
+        fprintf(stderr, "Unable to start the transmit thread\n");
+        return -1;
+    }
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_attr_setstacksize(&attr, RT_STACK_SIZE);
+
+    while (1) {
+        if ((client = accept(fd, NULL, NULL)) == -1) {
+            if (errno != EINTR) {
+                perror("accept");
+            }
+            continue;
+        }
+        if (pthread_create(&thread, &attr, client_thread,
+                (void *) (intptr_t) client) != 0) {
+            close(client);
+        }
+    }
+
+    return 0;
+}
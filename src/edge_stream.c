@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2014 Sylvain Afchain
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <string.h>
+
+#include "edge_stream.h"
+#include "serial.h"
+
+void edge_stream_init(struct edge_stream *stream,
+        void (*output)(int type, unsigned int duration, void *arg), void *arg) {
+    memset(stream, 0, sizeof(struct edge_stream));
+    stream->output = output;
+    stream->arg = arg;
+}
+
+/* every record of a block, nothing when one of them is malformed */
+static int decode_block(struct edge_stream *stream) {
+    const unsigned char *p = stream->block + EDGE_STREAM_HEADER;
+    const unsigned char *end = p + stream->block[3];
+    const unsigned char *start = p;
+    unsigned int count = stream->block[2], value, shift, i;
+
+    /* validated first, a pulse is never delivered out of a broken block */
+    for (i = 0; i != count; i++) {
+        for (shift = 0; p != end && (*p & 0x80); p++, shift += 7);
+        if (p == end || shift > 28) {
+            return -1;
+        }
+        p++;
+    }
+    if (p != end) {
+        return -1;
+    }
+
+    for (p = start, i = 0; i != count; i++) {
+        value = 0;
+        shift = 0;
+        do {
+            value |= (*p & 0x7f) << shift;
+            shift += 7;
+        } while (*p++ & 0x80);
+
+        stream->output(value & 1, value >> 1, stream->arg);
+    }
+    stream->records += count;
+
+    return 0;
+}
+
+/* drop the first byte of the buffered block, up to the next magic */
+static void resync(struct edge_stream *stream) {
+    unsigned char *magic;
+
+    magic = memchr(stream->block + 1, EDGE_STREAM_MAGIC, stream->len - 1);
+    if (magic == NULL) {
+        stream->len = 0;
+        return;
+    }
+    stream->len -= magic - stream->block;
+    memmove(stream->block, magic, stream->len);
+}
+
+/* bytes read from the board, in chunks of any size */
+void edge_stream_feed(struct edge_stream *stream, const unsigned char *buffer,
+        unsigned int len) {
+    const unsigned char *magic;
+    unsigned int needed, n;
+    unsigned char seq;
+
+    while (len > 0 || stream->len >= EDGE_STREAM_HEADER) {
+        if (stream->len == 0) {
+            if ((magic = memchr(buffer, EDGE_STREAM_MAGIC, len)) == NULL) {
+                return;
+            }
+            len -= magic - buffer;
+            buffer = magic;
+        }
+
+        needed = EDGE_STREAM_HEADER;
+        if (stream->len >= EDGE_STREAM_HEADER) {
+            if (stream->block[3] > EDGE_STREAM_PAYLOAD) {
+                stream->errors++;
+                resync(stream);
+                continue;
+            }
+            needed += stream->block[3] + 1;
+        }
+
+        if (stream->len < needed) {
+            if (len == 0) {
+                return;
+            }
+            n = needed - stream->len;
+            if (n > len) {
+                n = len;
+            }
+            memcpy(stream->block + stream->len, buffer, n);
+            stream->len += n;
+            buffer += n;
+            len -= n;
+            continue;
+        }
+        if (needed == EDGE_STREAM_HEADER) {
+            continue;
+        }
+
+        if (stream->block[needed - 1] != serial_crc8(stream->block,
+                    needed - 1) || decode_block(stream) == -1) {
+            stream->errors++;
+            resync(stream);
+            continue;
+        }
+
+        seq = stream->block[1];
+        if (stream->started && seq != (unsigned char) (stream->seq + 1)) {
+            stream->lost += (unsigned char) (seq - stream->seq - 1);
+        }
+        stream->started = 1;
+        stream->seq = seq;
+        stream->blocks++;
+        stream->len = 0;
+    }
+}
+
+/*
+ * Pack as many pulses as fit in one block, as the board does, used set to
+ * their number. Returns the length of the block.
+ */
+unsigned int edge_stream_block(unsigned char *block, unsigned char seq,
+        const struct pulse *pulses, unsigned int count, unsigned int *used) {
+    unsigned char record[5];
+    unsigned int len = 0, n, value, i;
+
+    for (i = 0; i != count && i != 255; i++) {
+        value = pulses[i].duration << 1 | (pulses[i].type & 1);
+        for (n = 0; value >= 0x80; value >>= 7) {
+            record[n++] = value | 0x80;
+        }
+        record[n++] = value;
+
+        if (len + n > EDGE_STREAM_PAYLOAD) {
+            break;
+        }
+        memcpy(block + EDGE_STREAM_HEADER + len, record, n);
+        len += n;
+    }
+    *used = i;
+
+    block[0] = EDGE_STREAM_MAGIC;
+    block[1] = seq;
+    block[2] = i;
+    block[3] = len;
+    block[EDGE_STREAM_HEADER + len] = serial_crc8(block,
+            EDGE_STREAM_HEADER + len);
+
+    return EDGE_STREAM_HEADER + len + 1;
+}
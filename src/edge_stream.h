@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2014 Sylvain Afchain
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef __EDGE_STREAM_H__
+#define __EDGE_STREAM_H__
+
+#include "pulse.h"
+
+/*
+ * Pulses streamed by the Arduino receive front-end, see arduino/edges.ino,
+ * in blocks: magic, sequence number, record count, payload length, payload,
+ * CRC-8 of everything before it. Every record of the payload is a pulse,
+ * duration << 1 | level as an unsigned LEB128 varint, glitches already merged
+ * into the following pulse by the board.
+ */
+#define EDGE_STREAM_MAGIC 0xe5
+#define EDGE_STREAM_HEADER 4
+#define EDGE_STREAM_PAYLOAD 240
+#define EDGE_STREAM_BLOCK (EDGE_STREAM_HEADER + EDGE_STREAM_PAYLOAD + 1)
+
+struct edge_stream {
+    unsigned char block[EDGE_STREAM_BLOCK];
+    unsigned int len;
+    int started;
+    unsigned char seq;
+
+    void (*output)(int type, unsigned int duration, void *arg);
+    void *arg;
+
+    /* statistics */
+    unsigned long blocks;
+    unsigned long records;
+    unsigned long lost;
+    unsigned long errors;
+};
+
+void edge_stream_init(struct edge_stream *stream,
+        void (*output)(int type, unsigned int duration, void *arg), void *arg);
+void edge_stream_feed(struct edge_stream *stream, const unsigned char *buffer,
+        unsigned int len);
+unsigned int edge_stream_block(unsigned char *block, unsigned char seq,
+        const struct pulse *pulses, unsigned int count, unsigned int *used);
+
+#endif
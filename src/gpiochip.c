@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2014 Sylvain Afchain
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/ioctl.h>
+
+#include "gpiochip.h"
+
+/* returns the file descriptor of the line events, -1 on failure */
+int gpiochip_request(const char *chip, unsigned int line, const char *consumer) {
+    struct gpio_v2_line_request request;
+    int fd;
+
+    if ((fd = open(chip, O_RDONLY | O_CLOEXEC)) == -1) {
+        fprintf(stderr, "Unable to open the gpio chip %s: %s\n", chip,
+                strerror(errno));
+        return -1;
+    }
+
+    memset(&request, 0, sizeof(request));
+    request.offsets[0] = line;
+    request.num_lines = 1;
+    strncpy(request.consumer, consumer, sizeof(request.consumer) - 1);
+    request.config.flags = GPIO_V2_LINE_FLAG_INPUT |
+        GPIO_V2_LINE_FLAG_EDGE_RISING | GPIO_V2_LINE_FLAG_EDGE_FALLING;
+    request.event_buffer_size = GPIOCHIP_KERNEL_BUFFER;
+
+    if (ioctl(fd, GPIO_V2_GET_LINE_IOCTL, &request) == -1) {
+        fprintf(stderr, "Unable to request the line %u of %s: %s\n", line,
+                chip, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    close(fd);
+
+    return request.fd;
+}
+
+void gpiochip_edges_init(struct gpiochip_edges *edges,
+        void (*output)(int type, unsigned int duration, unsigned int timestamp,
+            void *arg), void *arg) {
+    memset(edges, 0, sizeof(struct gpiochip_edges));
+    edges->output = output;
+    edges->arg = arg;
+}
+
+/* the pulse ending at each edge, of the level before it */
+void gpiochip_edges_feed(struct gpiochip_edges *edges,
+        struct gpio_v2_line_event *events, unsigned int count) {
+    struct gpio_v2_line_event *event;
+    unsigned long long duration;
+    unsigned int i;
+
+    for (i = 0; i != count; i++) {
+        event = &events[i];
+
+        /* the kernel buffer overflowed, the pulse spans unknown edges */
+        if (edges->started && event->line_seqno != edges->line_seqno + 1) {
+            edges->lost += event->line_seqno - edges->line_seqno - 1;
+            edges->started = 0;
+        }
+        edges->line_seqno = event->line_seqno;
+        edges->events++;
+
+        if (edges->started) {
+            duration = (event->timestamp_ns - edges->last_ns) / 1000;
+            if (duration > UINT_MAX) {
+                duration = UINT_MAX;
+            }
+            edges->output(event->id == GPIO_V2_LINE_EVENT_FALLING_EDGE,
+                    duration, event->timestamp_ns / 1000, edges->arg);
+        }
+        edges->started = 1;
+        edges->last_ns = event->timestamp_ns;
+    }
+}
+
+/*
+ * As many events as available, up to GPIOCHIP_BATCH, in a single syscall.
+ * Returns the number of events, 0 at the end of a recorded file, -1 on error.
+ */
+int gpiochip_read(int fd, struct gpio_v2_line_event *events) {
+    ssize_t len;
+
+    do {
+        len = read(fd, events, GPIOCHIP_BATCH * sizeof(*events));
+    } while (len == -1 && errno == EINTR);
+
+    if (len == -1) {
+        return -1;
+    }
+
+    return len / sizeof(*events);
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2014 Sylvain Afchain
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef __GPIOCHIP_H__
+#define __GPIOCHIP_H__
+
+#include <linux/gpio.h>
+
+/* events taken from the kernel per read */
+#define GPIOCHIP_BATCH 64
+
+/* events the kernel keeps for us while the reader is late */
+#define GPIOCHIP_KERNEL_BUFFER 1024
+
+/*
+ * Edge events of the GPIO character device, line event ABI v2. Every event
+ * carries its direction and a kernel timestamp, so the level never has to be
+ * read back after the fact. Recorded event files are the same events, as
+ * read from the line, back to back.
+ */
+struct gpiochip_edges {
+    int started;
+    unsigned long long last_ns;
+    unsigned int line_seqno;
+
+    void (*output)(int type, unsigned int duration, unsigned int timestamp,
+            void *arg);
+    void *arg;
+
+    /* statistics */
+    unsigned long events;
+    unsigned long lost;
+};
+
+int gpiochip_request(const char *chip, unsigned int line, const char *consumer);
+void gpiochip_edges_init(struct gpiochip_edges *edges,
+        void (*output)(int type, unsigned int duration, unsigned int timestamp,
+            void *arg), void *arg);
+void gpiochip_edges_feed(struct gpiochip_edges *edges,
+        struct gpio_v2_line_event *events, unsigned int count);
+int gpiochip_read(int fd, struct gpio_v2_line_event *events);
+
+#endif
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2014 Sylvain Afchain
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <string.h>
+
+#include "histogram.h"
+
+static unsigned int bucket_of(unsigned long long value) {
+    unsigned int msb;
+
+    if (value < HISTOGRAM_SUB) {
+        return value;
+    }
+    msb = 63 - __builtin_clzll(value);
+
+    return (msb - 2) * HISTOGRAM_SUB + ((value >> (msb - 3)) & (HISTOGRAM_SUB - 1));
+}
+
+/* highest value falling into the bucket */
+static unsigned long long bucket_max(unsigned int bucket) {
+    unsigned int msb;
+
+    if (bucket < HISTOGRAM_SUB) {
+        return bucket;
+    }
+    msb = bucket / HISTOGRAM_SUB + 2;
+
+    return ((unsigned long long) (HISTOGRAM_SUB + bucket % HISTOGRAM_SUB + 1)
+            << (msb - 3)) - 1;
+}
+
+void histogram_init(struct histogram *histogram) {
+    memset(histogram, 0, sizeof(struct histogram));
+}
+
+void histogram_add(struct histogram *histogram, unsigned long long value) {
+    histogram->buckets[bucket_of(value)]++;
+    histogram->count++;
+    histogram->sum += value;
+    if (value > histogram->max) {
+        histogram->max = value;
+    }
+}
+
+void histogram_merge(struct histogram *to, struct histogram *from) {
+    int i;
+
+    for (i = 0; i != HISTOGRAM_BUCKETS; i++) {
+        to->buckets[i] += from->buckets[i];
+    }
+    to->count += from->count;
+    to->sum += from->sum;
+    if (from->max > to->max) {
+        to->max = from->max;
+    }
+}
+
+unsigned long long histogram_percentile(struct histogram *histogram,
+        double percentile) {
+    unsigned long long rank, seen = 0, value;
+    int i;
+
+    if (histogram->count == 0) {
+        return 0;
+    }
+
+    rank = histogram->count * percentile / 100.0;
+    if (rank == 0) {
+        rank = 1;
+    }
+
+    for (i = 0; i != HISTOGRAM_BUCKETS; i++) {
+        seen += histogram->buckets[i];
+        if (seen >= rank) {
+            value = bucket_max(i);
+            return value < histogram->max ? value : histogram->max;
+        }
+    }
+
+    return histogram->max;
+}
@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2014 Sylvain Afchain
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef __HISTOGRAM_H__
+#define __HISTOGRAM_H__
+
+/*
+ * Log-linear histogram of unsigned values: exact below 8, then 8 buckets per
+ * power of two, so any percentile is within 12.5% of the real value.
+ */
+#define HISTOGRAM_SUB 8
+#define HISTOGRAM_BUCKETS (64 * HISTOGRAM_SUB)
+
+struct histogram {
+    unsigned long count;
+    unsigned long long max;
+    unsigned long long sum;
+    unsigned long buckets[HISTOGRAM_BUCKETS];
+};
+
+void histogram_init(struct histogram *histogram);
+void histogram_add(struct histogram *histogram, unsigned long long value);
+void histogram_merge(struct histogram *to, struct histogram *from);
+unsigned long long histogram_percentile(struct histogram *histogram,
+        double percentile);
+
+#endif
@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2014 Sylvain Afchain
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include "homeasy.h"
+#include "ook_protocols.h"
+
+/* append one frame to the timeline, a group frame switches every receiver */
+void homeasy_compile(struct timeline *timeline, unsigned int address,
+        unsigned char receiver, unsigned char command, int group) {
+    unsigned int word;
+    unsigned char bits[4];
+
+    /* 26 bits of address, the group flag, the command and 4 bits of receiver */
+    word = address << 6 | (group != 0) << 5 | (command != 0) << 4 |
+        (receiver & 0xf);
+    bits[0] = word >> 24;
+    bits[1] = word >> 16;
+    bits[2] = word >> 8;
+    bits[3] = word;
+
+    ook_compile(timeline, &homeasy_ook, bits, 0);
+}
+
+/* the same command for every receiver code of the remote */
+int homeasy_is_group(struct homeasy_target *targets, unsigned int count) {
+    unsigned int seen = 0, i;
+
+    for (i = 0; i != count; i++) {
+        if (targets[i].command != targets[0].command) {
+            return 0;
+        }
+        seen |= 1 << targets[i].receiver;
+    }
+
+    return seen == (1 << HOMEASY_RECEIVERS) - 1;
+}
+
+/*
+ * The frames of several receivers of one remote, every round of a receiver
+ * back to back so a receiver sees them as one command. A single group frame
+ * train when they all get the same command, otherwise the trains of every
+ * receiver in turn. Returns the number of frames compiled.
+ */
+unsigned int homeasy_compile_group(struct timeline *timeline,
+        unsigned int address, struct homeasy_target *targets,
+        unsigned int count, unsigned int rounds) {
+    unsigned int train = homeasy_ook.frames * rounds, frames = 0, i, f;
+
+    if (homeasy_is_group(targets, count)) {
+        for (f = 0; f != train; f++) {
+            homeasy_compile(timeline, address, 0, targets[0].command, 1);
+        }
+
+        return train;
+    }
+
+    for (i = 0; i != count; i++) {
+        for (f = 0; f != train; f++) {
+            homeasy_compile(timeline, address, targets[i].receiver,
+                    targets[i].command, 0);
+        }
+        frames += train;
+    }
+
+    return frames;
+}
+
+/*
+ * Parse a <receiver>[:<command>][,...] list, or "all" for every receiver of
+ * the remote, command being used when a receiver has none. Returns the number
+ * of targets or -1.
+ */
+int homeasy_targets(char *spec, char command, struct homeasy_target *targets) {
+    char *token, *saveptr, *end;
+    unsigned int count = 0, i;
+    long int a2i;
+
+    if (strcmp(spec, "all") == 0) {
+        if (command == HOMEASY_UNKNOWN) {
+            return -1;
+        }
+        for (i = 0; i != HOMEASY_RECEIVERS; i++) {
+            targets[i].receiver = i;
+            targets[i].command = command;
+        }
+
+        return HOMEASY_RECEIVERS;
+    }
+
+    for (token = strtok_r(spec, ",", &saveptr); token != NULL;
+            token = strtok_r(NULL, ",", &saveptr)) {
+        if (count == HOMEASY_RECEIVERS) {
+            return -1;
+        }
+
+        errno = 0;
+        a2i = strtol(token, &end, 10);
+        if (errno != 0 || end == token || a2i < 0 ||
+                a2i >= HOMEASY_RECEIVERS) {
+            return -1;
+        }
+        targets[count].receiver = a2i;
+
+        targets[count].command = command;
+        if (*end == ':') {
+            targets[count].command = homeasy_command(end + 1);
+        } else if (*end != '\0') {
+            return -1;
+        }
+        if (targets[count].command == HOMEASY_UNKNOWN) {
+            return -1;
+        }
+        count++;
+    }
+
+    return count ? (int) count : -1;
+}
+
+const char *homeasy_command_name(unsigned char command) {
+    return command == HOMEASY_ON ? "on" : "off";
+}
+
+char homeasy_command(const char *command) {
+    if (strcasecmp(command, "on") == 0) {
+        return HOMEASY_ON;
+    } else if (strcasecmp(command, "off") == 0) {
+        return HOMEASY_OFF;
+    }
+
+    return HOMEASY_UNKNOWN;
+}
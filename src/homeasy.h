@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2014 Sylvain Afchain
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef __HOMEASY_H__
+#define __HOMEASY_H__
+
+#include "timeline.h"
+#include "ook.h"
+
+enum HOMEASY_COMMAND {
+    HOMEASY_OFF = 0,
+    HOMEASY_ON = 1,
+    HOMEASY_UNKNOWN
+};
+
+/* receiver codes of a remote, the group flag switches them all */
+#define HOMEASY_RECEIVERS 16
+
+/* 26 bits of remote address */
+#define HOMEASY_ADDRESS_MAX 0x3ffffff
+
+/* one receiver of a multi receiver transmission */
+struct homeasy_target {
+    unsigned char receiver;
+    unsigned char command;
+};
+
+struct homeasy_frame {
+    unsigned int address;
+    unsigned char group;
+    unsigned char command;
+    unsigned char receiver;
+};
+
+/* receive state for one pulse stream */
+struct homeasy_decoder {
+    struct ook_decoder ook;
+
+    /* statistics, never reset by homeasy_decoder_reset */
+    unsigned long syncs;
+    unsigned long sync_losses;
+    unsigned long frames;
+};
+
+char homeasy_command(const char *command);
+const char *homeasy_command_name(unsigned char command);
+void homeasy_compile(struct timeline *timeline, unsigned int address,
+        unsigned char receiver, unsigned char command, int group);
+int homeasy_is_group(struct homeasy_target *targets, unsigned int count);
+unsigned int homeasy_compile_group(struct timeline *timeline,
+        unsigned int address, struct homeasy_target *targets,
+        unsigned int count, unsigned int rounds);
+int homeasy_targets(char *spec, char command, struct homeasy_target *targets);
+
+void homeasy_decoder_init(struct homeasy_decoder *decoder);
+void homeasy_decoder_reset(struct homeasy_decoder *decoder);
+int homeasy_decoder_feed(struct homeasy_decoder *decoder, int type,
+        int duration, struct homeasy_frame *frame);
+
+#endif
@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2014 Sylvain Afchain
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "homeasy.h"
+#include "ook_protocols.h"
+#include "telemetry.h"
+
+extern int verbose;
+
+void homeasy_decoder_init(struct homeasy_decoder *decoder) {
+    memset(decoder, 0, sizeof(struct homeasy_decoder));
+    ook_decoder_init(&decoder->ook, &homeasy_ook);
+}
+
+void homeasy_decoder_reset(struct homeasy_decoder *decoder) {
+    ook_decoder_reset(&decoder->ook);
+}
+
+static void decode_frame(struct homeasy_decoder *decoder,
+        struct homeasy_frame *frame) {
+    unsigned char *b = decoder->ook.bits;
+    unsigned int bits = b[0] << 24 | b[1] << 16 | b[2] << 8 | b[3];
+
+    frame->receiver = bits & 0xf;
+    frame->command = (bits >> 4) & 0x1;
+    frame->group = (bits >> 5) & 0x1;
+    frame->address = bits >> 6;
+}
+
+int homeasy_decoder_feed(struct homeasy_decoder *decoder, int type,
+        int duration, struct homeasy_frame *frame) {
+    switch (ook_decoder_feed(&decoder->ook, &homeasy_ook, type, duration)) {
+        case OOK_SYNC:
+            TELEMETRY_INC(decoder->syncs);
+            if (verbose) {
+                fprintf(stderr, "Found the sync part of a HomeEasy message\n");
+            }
+            return 0;
+        case OOK_FRAME:
+            decode_frame(decoder, frame);
+            TELEMETRY_INC(decoder->frames);
+            return 1;
+        case OOK_ERROR:
+            if (verbose) {
+                fprintf(stderr, "Error while reading a HomeEasy bit\n");
+            }
+            TELEMETRY_INC(decoder->sync_losses);
+            return -1;
+    }
+
+    return decoder->ook.state == OOK_BITS ? 0 : -1;
+}
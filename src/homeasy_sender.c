@@ -14,6 +14,8 @@
  * 02110-1301, USA.
  */
 
+#define _GNU_SOURCE
+
 #include <wiringPi.h>
 #include <stdio.h>
 #include <syslog.h>
@@ -25,117 +27,92 @@
 #include <sys/types.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <time.h>
 
 #include "common.h"
+#include "homeasy.h"
+#include "ook_protocols.h"
+#include "client.h"
+#include "protocol.h"
+#include "serial.h"
+#include "rt.h"
 
-enum COMMAND {
-    OFF = 0,
-    ON = 1,
-    UNKNOWN
-};
-
-static void _write_bit(int gpio, char bit) {
-    if (bit) {
-        digitalWrite(gpio, HIGH);
-        delayMicroseconds(300);
-        digitalWrite(gpio, LOW);
-        delayMicroseconds(1300);
-    } else {
-        digitalWrite(gpio, HIGH);
-        delayMicroseconds(300);
-        digitalWrite(gpio, LOW);
-        delayMicroseconds(300);
-    }
-}
-
-static void write_bit(int gpio, char bit) {
-    if (bit) {
-        _write_bit(gpio, 1);
-        _write_bit(gpio, 0);
-    } else {
-        _write_bit(gpio, 0);
-        _write_bit(gpio, 1);
-    }
-}
-
-static void sync_transmit(int gpio) {
-    digitalWrite(gpio, HIGH);
-    delayMicroseconds(275);
-    digitalWrite(gpio, LOW);
-    delayMicroseconds(9900);
-    digitalWrite(gpio, HIGH);
-    delayMicroseconds(275);
-    digitalWrite(gpio, LOW);
-    delayMicroseconds(2600);
-    digitalWrite(gpio, HIGH);
-}
-
-static void write_interval_gap(int gpio) {
-    digitalWrite(gpio, HIGH);
-    delayMicroseconds(275);
-    digitalWrite(gpio, LOW);
-    delay(10);
+static void usage(char *name) {
+    printf(
+        "Usage: %s (--gpio <gpio pin> | --serial <device>) --address <remote address> "
+        "--comand <command> [--receiver <receiver>[:<command>][,<receiver>[:<command>]]...|all] "
+        "[--retry <count>] [--dry-run[=<trace file>]] [--stats] [--spin-us <us>] "
+        "[--rt <spec>]...\n",
+        name);
+    rt_usage(stdout);
+    exit(-1);
 }
 
-void transmit(int gpio, unsigned int address, unsigned char receiver,
-              unsigned char command) {
-    unsigned int mask;
-
-    sync_transmit(gpio);
+/*
+ * Hand the trains over to the transmit coprocessor, a single group command
+ * when possible, every round of a receiver in one command.
+ */
+static int serial_send(const char *device, unsigned int address,
+        struct homeasy_target *targets, unsigned int count, int retry,
+        int stats) {
+    struct serial_command command;
+    struct serial_ack ack;
+    unsigned int i;
+    int fd;
 
-    for (mask = 0x2000000; mask != 0x0; mask >>= 1) {
-        if (address & mask) {
-            write_bit(gpio, 1);
-        } else {
-            write_bit(gpio, 0);
-        }
+    if ((fd = serial_open(device)) == -1) {
+        return -1;
     }
 
-    // never grouped
-    write_bit(gpio, 0);
-
-    write_bit(gpio, command);
-
-    for (mask = 0b1000; mask != 0x0; mask >>= 1) {
-        write_bit(gpio, receiver & mask);
+    memset(&command, 0, sizeof(command));
+    command.protocol = PROTOCOL_HOMEASY;
+    command.address = address;
+    command.frames = homeasy_ook.frames * retry;
+    command.seq = rand();
+    if (homeasy_is_group(targets, count)) {
+        command.flags = SERIAL_GROUP;
+        count = 1;
     }
+    for (i = 0; i != count; i++) {
+        command.seq++;
+        command.receiver = command.flags ? 0 : targets[i].receiver;
+        command.command = targets[i].command;
 
-    write_interval_gap(gpio);
-}
-
-static char get_command_char(char *command) {
-    if (strcasecmp(command, "on") == 0) {
-        return ON;
-    } else if (strcasecmp(command, "off") == 0) {
-        return OFF;
+        if (serial_transmit(fd, &command, &ack, command.frames * 100 + 1000)) {
+            close(fd);
+            return -1;
+        }
+        if (stats) {
+            printf("receiver: %u, frames: %u, airtime: %u us, latest edge: %u us\n",
+                    command.receiver, ack.frames, ack.airtime, ack.late);
+        }
     }
+    close(fd);
 
-    return UNKNOWN;
-}
-
-static void usage(char *name) {
-    printf(
-        "Usage: %s --gpio <gpio pin> --address <remote address> --comand <command>\n",
-        name);
-    exit(-1);
+    return 0;
 }
 
 int main(int argc, char** argv) {
     struct option long_options[] = { { "gpio", 1, 0, 0 },
         { "address", 1, 0, 0 }, { "command", 1, 0, 0 }, { "receiver", 1, 0, 0 },
-        { "retry", 1, 0, 0 }, { NULL, 0, 0, 0 } };
-    unsigned int address = 0;
-    unsigned char receiver = 1;
+        { "retry", 1, 0, 0 }, { "dry-run", 2, 0, 0 },
+        { "stats", 0, 0, 0 }, { "spin-us", 1, 0, 0 }, { "serial", 1, 0, 0 },
+        { "rt", 1, 0, 0 }, { NULL, 0, 0, 0 } };
+    static struct timeline_stats timeline_stats;
+    struct rt_config rt;
+    struct timeline timeline;
+    struct homeasy_target targets[HOMEASY_RECEIVERS];
+    unsigned int address = 0, frames = 0, count;
     long int a2i;
     int gpio = -1;
-    char command = UNKNOWN;
-    char *end;
-    int retry = 5, i, c;
+    char command = HOMEASY_UNKNOWN;
+    char *end, *trace = NULL, *receivers = NULL, *serial = NULL;
+    char request[CLIENT_LINE_MAX], reply[CLIENT_LINE_MAX];
+    char spec[CLIENT_LINE_MAX / 2];
+    int retry = 5, len = 0, i, c;
+    int dry_run = 0, stats = 0, tuned = 0;
 
-    if (setuid(0)) {
-        perror("setuid");
-        return -1;
-    }
+    rt_init(&rt);
 
     while (1) {
         c = getopt_long(argc, argv, "", long_options, &i);
@@ -156,19 +133,38 @@ int main(int argc, char** argv) {
                     }
                     address = a2i;
                 } else if (strcmp(long_options[i].name, "receiver") == 0) {
+                    receivers = optarg;
+                } else if (strcmp(long_options[i].name, "command") == 0) {
+                    command = homeasy_command(optarg);
+                } else if (strcmp(long_options[i].name, "retry") == 0) {
                     a2i = strtol(optarg, &end, 10);
                     if (errno == ERANGE && (a2i == LONG_MAX || a2i == LONG_MIN)) {
                         break;
                     }
-                    receiver = a2i;
-                } else if (strcmp(long_options[i].name, "command") == 0) {
-                    command = get_command_char(optarg);
-                } else if (strcmp(long_options[i].name, "command") == 0) {
+                    retry = a2i;
+                } else if (strcmp(long_options[i].name, "dry-run") == 0) {
+                    dry_run = 1;
+                    trace = optarg;
+                } else if (strcmp(long_options[i].name, "stats") == 0) {
+                    stats = 1;
+                    tuned = 1;
+                } else if (strcmp(long_options[i].name, "spin-us") == 0) {
+                    tuned = 1;
                     a2i = strtol(optarg, &end, 10);
                     if (errno == ERANGE && (a2i == LONG_MAX || a2i == LONG_MIN)) {
                         break;
                     }
-                    retry = a2i;
+                    if (a2i < 0) {
+                        usage(argv[0]);
+                    }
+                    timeline_set_spin(a2i);
+                } else if (strcmp(long_options[i].name, "serial") == 0) {
+                    serial = optarg;
+                } else if (strcmp(long_options[i].name, "rt") == 0) {
+                    tuned = 1;
+                    if (rt_parse(&rt, optarg) == -1) {
+                        usage(argv[0]);
+                    }
                 }
                 break;
             default:
@@ -176,8 +172,81 @@ int main(int argc, char** argv) {
         }
     }
 
-    if (command == UNKNOWN || address == 0 || gpio == -1 || receiver == 0) {
+    /* the frames of a serial command are counted on a byte */
+    if (address == 0 || address > HOMEASY_ADDRESS_MAX || retry <= 0 ||
+            (gpio == -1 && serial == NULL && ! dry_run) ||
+            (serial != NULL && retry > 255 / homeasy_ook.frames)) {
+        usage(argv[0]);
+    }
+
+    if (receivers == NULL) {
+        if (command == HOMEASY_UNKNOWN) {
+            usage(argv[0]);
+        }
+        targets[0].receiver = 1;
+        targets[0].command = command;
+        count = 1;
+    } else if ((c = homeasy_targets(receivers, command, targets)) == -1) {
         usage(argv[0]);
+    } else {
+        count = c;
+    }
+
+    /* every round back to back, the receivers act on the first good frame */
+    timeline_init(&timeline);
+    frames = homeasy_compile_group(&timeline, address, targets, count, retry);
+    if (receivers != NULL) {
+        fprintf(stderr, "%u receivers, %u frames, airtime: %.1f ms\n", count,
+                frames, timeline.length_ns / 1e6);
+    }
+
+    timeline_stats_init(&timeline_stats);
+
+    if (dry_run) {
+        if (stats) {
+            timeline_play(&timeline, gpio, NULL, &timeline_stats);
+            timeline_stats_print(&timeline_stats, stdout);
+        } else if (trace == NULL) {
+            timeline_dump(&timeline, stdout);
+        } else if (timeline_save(&timeline, trace) == -1) {
+            fprintf(stderr, "Unable to write the trace file: %s\n", trace);
+            return -1;
+        }
+
+        return 0;
+    }
+
+    /* the board keeps the timing, no real time priority needed here */
+    if (serial != NULL) {
+        srand(time(NULL));
+        return serial_send(serial, address, targets, count, retry, stats);
+    }
+
+    if (setuid(0)) {
+        perror("setuid");
+        return -1;
+    }
+
+    /* hand the command over to domiotoolsd when it is running */
+    for (i = 0; i != (int) count && len < (int) sizeof(spec); i++) {
+        len += snprintf(spec + len, sizeof(spec) - len, "%s%u:%s",
+                i ? "," : "", targets[i].receiver,
+                homeasy_command_name(targets[i].command));
+    }
+    snprintf(request, sizeof(request), "homeasy %d %u %s %s %d\n", gpio,
+            address, spec, homeasy_command_name(targets[0].command), retry);
+    if (client_request(DOMIOTOOLSD_SOCKET, request, reply,
+            sizeof(reply)) == 0) {
+        /* the transmission is timed by the daemon, not by this process */
+        if (tuned) {
+            fprintf(stderr, "Sent through domiotoolsd, --stats, --spin-us "
+                    "and --rt ignored\n");
+        }
+        if (strncmp(reply, "ok", 2) != 0) {
+            fprintf(stderr, "domiotoolsd: %s", reply);
+            return -1;
+        }
+        return 0;
     }
 
     // store pid and lock it
@@ -189,19 +258,20 @@ int main(int argc, char** argv) {
     }
 
     openlog("homeasy", LOG_PID | LOG_CONS, LOG_USER);
-    syslog(LOG_INFO, "remote: %d, receiver, %d, command: %d\n", address,
-           receiver, command);
+    for (i = 0; i != (int) count; i++) {
+        syslog(LOG_INFO, "remote: %d, receiver, %d, command: %d\n", address,
+               targets[i].receiver, targets[i].command);
+    }
     closelog();
 
     pinMode(gpio, OUTPUT);
-    piHiPri(99);
-
-    for (c = 0; c != retry; c++) {
-        for (i = 0; i < 5; i++) {
-            transmit(gpio, address, receiver, command);
-        }
+    rt_lock_memory(&rt);
+    rt_apply(&rt, RT_TRANSMIT);
 
-        sleep(1);
+    timeline_play(&timeline, gpio, digitalWrite,
+            stats ? &timeline_stats : NULL);
+    if (stats) {
+        timeline_stats_print(&timeline_stats, stdout);
     }
 
     return 0;
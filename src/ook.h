@@ -0,0 +1,413 @@
+/*
+ * Copyright (C) 2014 Sylvain Afchain
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef __OOK_H__
+#define __OOK_H__
+
+#include <string.h>
+
+#include "timeline.h"
+
+/*
+ * Generic on-off keying engine. A remote is described by a constant table,
+ * the pulses around its frames and the pulses of its two symbols, and is
+ * sent and received by the functions below. They are forced inline so that
+ * every protocol gets its own copy, with the table folded into the code, as
+ * fast as the hand written state machines they replace.
+ */
+
+#define OOK_INLINE static inline __attribute__((always_inline))
+
+/* most pulses of a sequence */
+#define OOK_ELEMENTS 4
+
+/* longest frame */
+#define OOK_MAX_BITS 64
+
+struct ook_element {
+    unsigned int level;
+    unsigned int us;
+};
+
+struct ook_sequence {
+    unsigned int count;
+    struct ook_element elements[OOK_ELEMENTS];
+};
+
+struct ook_protocol {
+    const char *name;
+
+    /* before the first frame of a train only */
+    struct ook_sequence wakeup;
+    /* repeated syncs before the first frame and before its repeats */
+    struct ook_sequence sync;
+    unsigned int syncs;
+    unsigned int repeat_syncs;
+    /* marks the start of the bits, right after the syncs */
+    struct ook_sequence start;
+    /* zero then one, with as many pulses, bits sent most significant first */
+    struct ook_sequence symbols[2];
+    unsigned int bits;
+    /* after each frame */
+    struct ook_sequence trailer;
+    /* frames of a train, the first one and its repeats */
+    unsigned int frames;
+
+    /* syncs to receive before a start is accepted */
+    unsigned int min_syncs;
+    /* timing errors accepted, in percent, for the syncs and for the symbols */
+    unsigned int sync_tolerance;
+    unsigned int tolerance;
+    /*
+     * Clock drift accepted, in percent, the transmitter clock is then measured
+     * on the syncs and the symbols are read against it. 0 for a fixed clock.
+     */
+    unsigned int drift;
+};
+
+enum OOK_STATE {
+    OOK_SEARCH = 0,
+    OOK_START,
+    OOK_BITS
+};
+
+enum OOK_RESULT {
+    OOK_NONE = 0,
+    OOK_SYNC,
+    OOK_FRAME,
+    OOK_ERROR
+};
+
+/* receive state for one pulse stream and one protocol */
+struct ook_decoder {
+    int calibrate;
+    unsigned int state;
+    unsigned int syncs;
+    unsigned int element;
+    unsigned int partial[OOK_ELEMENTS];
+    unsigned int measured;
+    unsigned int nominal;
+    unsigned int candidates;
+    /* durations of the symbols at the clock of the transmitter */
+    unsigned int scaled[2][OOK_ELEMENTS];
+    unsigned int count;
+    unsigned char bits[OOK_MAX_BITS / 8];
+};
+
+OOK_INLINE void ook_write(struct timeline *timeline,
+        const struct ook_sequence *sequence) {
+    unsigned int i;
+
+    for (i = 0; i != sequence->count; i++) {
+        timeline_pulse(timeline, sequence->elements[i].level,
+                sequence->elements[i].us);
+    }
+}
+
+/* append one frame to the timeline, the first of a train is not repeated */
+OOK_INLINE void ook_compile(struct timeline *timeline,
+        const struct ook_protocol *protocol, const unsigned char *bits,
+        int repeated) {
+    unsigned int syncs = protocol->syncs, i;
+
+    if (repeated) {
+        syncs = protocol->repeat_syncs;
+    } else {
+        ook_write(timeline, &protocol->wakeup);
+    }
+    for (i = 0; i != syncs; i++) {
+        ook_write(timeline, &protocol->sync);
+    }
+    ook_write(timeline, &protocol->start);
+
+    for (i = 0; i != protocol->bits; i++) {
+        ook_write(timeline,
+                &protocol->symbols[(bits[i / 8] >> (7 - i % 8)) & 1]);
+    }
+    ook_write(timeline, &protocol->trailer);
+}
+
+OOK_INLINE void ook_decoder_reset(struct ook_decoder *decoder) {
+    decoder->state = OOK_SEARCH;
+    decoder->syncs = 0;
+    decoder->element = 0;
+    decoder->measured = 0;
+    decoder->nominal = 0;
+}
+
+OOK_INLINE void ook_decoder_init(struct ook_decoder *decoder,
+        const struct ook_protocol *protocol) {
+    memset(decoder, 0, sizeof(struct ook_decoder));
+    decoder->calibrate = protocol->drift != 0;
+}
+
+/* a nominal duration at the clock of the transmitter */
+OOK_INLINE unsigned int ook_scaled(struct ook_decoder *decoder,
+        const struct ook_protocol *protocol, unsigned int us) {
+    if (! protocol->drift || ! decoder->calibrate || ! decoder->nominal) {
+        return us;
+    }
+
+    return (unsigned long long) us * decoder->measured / decoder->nominal;
+}
+
+OOK_INLINE int ook_near(unsigned int duration, unsigned int expected,
+        unsigned int tolerance) {
+    unsigned int error = duration > expected ? duration - expected :
+        expected - duration;
+
+    return error * 100 < expected * tolerance;
+}
+
+/* units pulses of n us, the error is counted in parts of a single unit */
+OOK_INLINE int ook_units(unsigned int duration, unsigned int n,
+        unsigned int units, unsigned int tolerance) {
+    unsigned int expected = units * n;
+    unsigned int error = duration > expected ? duration - expected :
+        expected - duration;
+
+    return error * 100 < n * tolerance;
+}
+
+/*
+ * The first sync of a drifting transmitter is accepted in the drift window,
+ * the next ones must then agree with it.
+ */
+OOK_INLINE int ook_sync_match(struct ook_decoder *decoder,
+        const struct ook_protocol *protocol, unsigned int us,
+        unsigned int duration) {
+    if (protocol->drift && decoder->calibrate && ! decoder->nominal) {
+        return ook_near(duration, us, protocol->drift);
+    }
+
+    return ook_near(duration, ook_scaled(decoder, protocol, us),
+            protocol->sync_tolerance);
+}
+
+OOK_INLINE void ook_measure(struct ook_decoder *decoder, unsigned int us,
+        unsigned int duration) {
+    decoder->measured += duration;
+    decoder->nominal += us;
+}
+
+OOK_INLINE void ook_begin_bits(struct ook_decoder *decoder,
+        const struct ook_protocol *protocol) {
+    unsigned int bit, i;
+
+    for (bit = 0; bit != 2; bit++) {
+        for (i = 0; i != protocol->symbols[bit].count; i++) {
+            decoder->scaled[bit][i] = ook_scaled(decoder, protocol,
+                    protocol->symbols[bit].elements[i].us);
+        }
+    }
+    decoder->state = OOK_BITS;
+    decoder->element = 0;
+    decoder->candidates = 3;
+    decoder->count = 0;
+    memset(decoder->bits, 0, sizeof(decoder->bits));
+}
+
+/*
+ * One pulse of nominal duration, matched against the same pulse of both
+ * symbols until only one is left when the symbol ends.
+ */
+OOK_INLINE int ook_unit(struct ook_decoder *decoder,
+        const struct ook_protocol *protocol, unsigned int level,
+        unsigned int us) {
+    const struct ook_element *element;
+    unsigned int bit;
+
+    for (bit = 0; bit != 2; bit++) {
+        element = &protocol->symbols[bit].elements[decoder->element];
+        if (element->level != level || element->us != us) {
+            decoder->candidates &= ~(1 << bit);
+        }
+    }
+    if (! decoder->candidates) {
+        return OOK_ERROR;
+    }
+
+    if (++decoder->element != protocol->symbols[0].count) {
+        return OOK_NONE;
+    }
+    if (decoder->candidates == 3) {
+        return OOK_ERROR;
+    }
+    bit = decoder->candidates >> 1;
+    decoder->bits[decoder->count / 8] |= bit << (7 - decoder->count % 8);
+    decoder->element = 0;
+    decoder->candidates = 3;
+
+    if (++decoder->count == protocol->bits) {
+        ook_decoder_reset(decoder);
+        return OOK_FRAME;
+    }
+
+    return OOK_NONE;
+}
+
+/*
+ * A pulse of the bits may be made of two pulses of the same duration and
+ * level, the end of a symbol and the beginning of the next one. The last one
+ * of a frame may run into the trailer.
+ */
+OOK_INLINE int ook_read_bits(struct ook_decoder *decoder,
+        const struct ook_protocol *protocol, unsigned int level,
+        unsigned int duration) {
+    const struct ook_element *element;
+    unsigned int last, bit, n;
+    int rtv;
+
+    last = decoder->count + 1 == protocol->bits &&
+        decoder->element + 1 == protocol->symbols[0].count;
+
+    for (bit = 0; bit != 2; bit++) {
+        element = &protocol->symbols[bit].elements[decoder->element];
+        if (! (decoder->candidates & (1 << bit)) || element->level != level) {
+            continue;
+        }
+
+        n = decoder->scaled[bit][decoder->element];
+        if (ook_units(duration, n, 1, protocol->tolerance) ||
+                (last && duration * 100 > n * (100 - protocol->tolerance))) {
+            return ook_unit(decoder, protocol, level, element->us);
+        }
+        if (ook_units(duration, n, 2, protocol->tolerance)) {
+            rtv = ook_unit(decoder, protocol, level, element->us);
+            if (rtv != OOK_NONE) {
+                return rtv;
+            }
+            return ook_unit(decoder, protocol, level, element->us);
+        }
+    }
+
+    return OOK_ERROR;
+}
+
+/*
+ * The last pulse of the start may run into the first symbol, the rest is
+ * then read as units of the bits.
+ */
+OOK_INLINE int ook_read_start(struct ook_decoder *decoder,
+        const struct ook_protocol *protocol, unsigned int level,
+        unsigned int duration) {
+    const struct ook_element *element =
+        &protocol->start.elements[decoder->element];
+    unsigned int n, units;
+
+    if (element->level != level) {
+        return OOK_ERROR;
+    }
+
+    if (decoder->element + 1 != protocol->start.count) {
+        if (! ook_sync_match(decoder, protocol, element->us, duration)) {
+            return OOK_ERROR;
+        }
+        ook_measure(decoder, element->us, duration);
+        decoder->element++;
+
+        return OOK_NONE;
+    }
+
+    n = ook_scaled(decoder, protocol, element->us);
+    units = (duration + n / 2) / n;
+    if (units == 0 || units > 2 ||
+            ! ook_units(duration, n, units, protocol->tolerance)) {
+        return OOK_ERROR;
+    }
+
+    ook_begin_bits(decoder, protocol);
+    if (units == 2 &&
+            ook_unit(decoder, protocol, level, element->us) != OOK_NONE) {
+        return OOK_ERROR;
+    }
+
+    return OOK_SYNC;
+}
+
+/* the syncs, the one being read may turn out to be the start */
+OOK_INLINE int ook_search(struct ook_decoder *decoder,
+        const struct ook_protocol *protocol, unsigned int level,
+        unsigned int duration) {
+    const struct ook_element *element =
+        &protocol->sync.elements[decoder->element];
+    unsigned int i;
+
+    if (element->level == level &&
+            ook_sync_match(decoder, protocol, element->us, duration)) {
+        ook_measure(decoder, element->us, duration);
+        decoder->partial[decoder->element] = duration;
+        if (++decoder->element == protocol->sync.count) {
+            decoder->element = 0;
+            decoder->syncs++;
+        }
+
+        return OOK_NONE;
+    }
+
+    if (decoder->syncs >= protocol->min_syncs &&
+            decoder->element < protocol->start.count) {
+        for (i = 0; i != decoder->element; i++) {
+            if (protocol->start.elements[i].level !=
+                    protocol->sync.elements[i].level ||
+                    ! ook_sync_match(decoder, protocol,
+                        protocol->start.elements[i].us, decoder->partial[i])) {
+                break;
+            }
+        }
+        if (i == decoder->element) {
+            decoder->state = OOK_START;
+
+            return ook_read_start(decoder, protocol, level, duration);
+        }
+    }
+
+    return OOK_ERROR;
+}
+
+/*
+ * Feed one pulse, of level type for duration us. Returns OOK_SYNC when the
+ * start of a frame is found, OOK_FRAME when its bits are all received, in
+ * decoder->bits, and OOK_ERROR when a frame being received is lost.
+ */
+OOK_INLINE int ook_decoder_feed(struct ook_decoder *decoder,
+        const struct ook_protocol *protocol, unsigned int type,
+        unsigned int duration) {
+    int rtv = OOK_NONE, state = decoder->state;
+
+    switch (state) {
+        case OOK_SEARCH:
+            rtv = ook_search(decoder, protocol, type, duration);
+            break;
+        case OOK_START:
+            rtv = ook_read_start(decoder, protocol, type, duration);
+            break;
+        case OOK_BITS:
+            rtv = ook_read_bits(decoder, protocol, type, duration);
+            break;
+    }
+    if (rtv != OOK_ERROR) {
+        return rtv;
+    }
+
+    /* not the expected pulse, it may still be the first one of a new sync */
+    ook_decoder_reset(decoder);
+    ook_search(decoder, protocol, type, duration);
+
+    return state == OOK_BITS ? OOK_ERROR : OOK_NONE;
+}
+
+#endif
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2014 Sylvain Afchain
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef __OOK_PROTOCOLS_H__
+#define __OOK_PROTOCOLS_H__
+
+#include "ook.h"
+
+/*
+ * Description of every remote, durations in micro seconds. An entry is all
+ * ook.h needs to send and to decode the bits of a remote sending fixed frames
+ * of pulse coded bits. Receiving it in signal_eventd also takes a PROTOCOL_
+ * value and a frame member in protocol.h, a dispatch row in protocol.c, a
+ * dedupe key in dedupe.c, a registry key in registry.c and a handler.
+ */
+
+/* Somfy RTS, manchester coded, a one is low then high */
+static const struct ook_protocol srts_ook = {
+    .name = "somfy",
+    .wakeup = { 2, { { 1, 12400 }, { 0, 80600 } } },
+    .sync = { 2, { { 1, 2560 }, { 0, 2560 } } },
+    .syncs = 2,
+    .repeat_syncs = 7,
+    .start = { 2, { { 1, 4800 }, { 0, 660 } } },
+    .symbols = {
+        { 2, { { 1, 660 }, { 0, 660 } } },
+        { 2, { { 0, 660 }, { 1, 660 } } },
+    },
+    .bits = 56,
+    .trailer = { 1, { { 0, 30400 } } },
+    .frames = 8,
+    .min_syncs = 2,
+    .sync_tolerance = 10,
+    .tolerance = 50,
+    .drift = 25,
+};
+
+/* HomeEasy, each bit as a short and a long space, a one is long first */
+static const struct ook_protocol homeasy_ook = {
+    .name = "homeasy",
+    .sync = { 2, { { 1, 275 }, { 0, 9900 } } },
+    .syncs = 1,
+    .repeat_syncs = 1,
+    .start = { 2, { { 1, 275 }, { 0, 2600 } } },
+    .symbols = {
+        { 4, { { 1, 300 }, { 0, 300 }, { 1, 300 }, { 0, 1300 } } },
+        { 4, { { 1, 300 }, { 0, 1300 }, { 1, 300 }, { 0, 300 } } },
+    },
+    .bits = 32,
+    .trailer = { 2, { { 1, 275 }, { 0, 10000 } } },
+    .frames = 5,
+    .min_syncs = 1,
+    .sync_tolerance = 45,
+    .tolerance = 45,
+};
+
+#endif
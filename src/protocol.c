@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2014 Sylvain Afchain
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <string.h>
+
+#include "protocol.h"
+
+static void srts_reset(void *state) {
+    srts_decoder_reset((struct srts_decoder *) state);
+}
+
+static int srts_feed(void *state, int type, int duration, struct frame *frame) {
+    return srts_decoder_feed((struct srts_decoder *) state, type, duration,
+            &frame->srts);
+}
+
+static void homeasy_reset(void *state) {
+    homeasy_decoder_reset((struct homeasy_decoder *) state);
+}
+
+static int homeasy_feed(void *state, int type, int duration,
+        struct frame *frame) {
+    return homeasy_decoder_feed((struct homeasy_decoder *) state, type,
+            duration, &frame->homeasy);
+}
+
+const struct protocol protocols[PROTOCOL_COUNT] = {
+    /* the repeats of a train are sent back to back */
+    [PROTOCOL_SRTS] = { "somfy", 400, 90000, 250000, srts_reset, srts_feed },
+    /* every round of a receiver back to back too, a frame every 94 ms */
+    [PROTOCOL_HOMEASY] = { "homeasy", 150, 11500, 250000, homeasy_reset,
+        homeasy_feed },
+};
+
+void protocol_init(struct protocol_dispatch *dispatch,
+        void (*output)(struct frame *frame, void *arg), void *arg) {
+    memset(dispatch, 0, sizeof(struct protocol_dispatch));
+
+    srts_decoder_init(&dispatch->srts);
+    homeasy_decoder_init(&dispatch->homeasy);
+
+    dispatch->slots[PROTOCOL_SRTS].protocol = &protocols[PROTOCOL_SRTS];
+    dispatch->slots[PROTOCOL_SRTS].state = &dispatch->srts;
+    dispatch->slots[PROTOCOL_HOMEASY].protocol = &protocols[PROTOCOL_HOMEASY];
+    dispatch->slots[PROTOCOL_HOMEASY].state = &dispatch->homeasy;
+
+    dispatch->output = output;
+    dispatch->arg = arg;
+}
+
+void protocol_feed(struct protocol_dispatch *dispatch, int type, int duration) {
+    struct protocol_slot *slot;
+    struct frame frame;
+    int i;
+
+    for (i = 0; i != PROTOCOL_COUNT; i++) {
+        slot = &dispatch->slots[i];
+
+        /* can not be part of a frame, drop any partial one, once */
+        if (duration < slot->protocol->min_pulse ||
+                duration > slot->protocol->max_pulse) {
+            if (slot->active) {
+                slot->protocol->reset(slot->state);
+                slot->active = 0;
+            }
+            continue;
+        }
+        slot->active = 1;
+
+        if (slot->protocol->feed(slot->state, type, duration, &frame) == 1) {
+            frame.protocol = i;
+            dispatch->output(&frame, dispatch->arg);
+        }
+    }
+}
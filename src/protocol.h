@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2014 Sylvain Afchain
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef __PROTOCOL_H__
+#define __PROTOCOL_H__
+
+#include "srts.h"
+#include "homeasy.h"
+
+enum PROTOCOL {
+    PROTOCOL_SRTS = 0,
+    PROTOCOL_HOMEASY,
+    PROTOCOL_COUNT
+};
+
+/* decoded frame, whatever the protocol */
+struct frame {
+    int protocol;
+    union {
+        struct srts_payload srts;
+        struct homeasy_frame homeasy;
+    };
+};
+
+/*
+ * A protocol state machine. min_pulse and max_pulse bound the pulses, in
+ * micro seconds, that can be part of one of its frames, anything outside is
+ * rejected before reaching the state machine. Identical frames less than
+ * repeat_window micro seconds apart are repeats of the same command.
+ */
+struct protocol {
+    const char *name;
+    int min_pulse;
+    int max_pulse;
+    unsigned int repeat_window;
+    void (*reset)(void *state);
+    int (*feed)(void *state, int type, int duration, struct frame *frame);
+};
+
+struct protocol_slot {
+    const struct protocol *protocol;
+    void *state;
+    int active;
+};
+
+/* every registered protocol decoding the same pulse stream in one pass */
+struct protocol_dispatch {
+    struct protocol_slot slots[PROTOCOL_COUNT];
+    struct srts_decoder srts;
+    struct homeasy_decoder homeasy;
+    void (*output)(struct frame *frame, void *arg);
+    void *arg;
+};
+
+extern const struct protocol protocols[PROTOCOL_COUNT];
+
+void protocol_init(struct protocol_dispatch *dispatch,
+        void (*output)(struct frame *frame, void *arg), void *arg);
+void protocol_feed(struct protocol_dispatch *dispatch, int type, int duration);
+
+#endif
@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2014 Sylvain Afchain
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef __PULSE_H__
+#define __PULSE_H__
+
+/* edges shorter than this are merged into the following one */
+#define PULSE_GLITCH 200
+
+/* type is the level of the pulse that just ended, duration in micro seconds */
+struct pulse {
+    unsigned int type;
+    unsigned int duration;
+    unsigned int timestamp;
+};
+
+struct pulse_filter {
+    unsigned int total_duration;
+};
+
+/*
+ * Simple noise reduction: returns 1 with the merged duration once a pulse
+ * long enough to be part of a message ends, 0 while absorbing glitches.
+ */
+static inline int pulse_filter(struct pulse_filter *filter,
+        unsigned int duration, unsigned int *merged) {
+    filter->total_duration += duration;
+    if (duration > PULSE_GLITCH) {
+        *merged = filter->total_duration;
+        filter->total_duration = 0;
+
+        return 1;
+    }
+
+    return 0;
+}
+
+#endif
@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2014 Sylvain Afchain
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef __PULSE_RING_H__
+#define __PULSE_RING_H__
+
+#include <string.h>
+
+#include "pulse.h"
+
+/* must be a power of two, 4096 edges is several seconds of signal */
+#define PULSE_RING_SIZE 4096
+#define PULSE_RING_MASK (PULSE_RING_SIZE - 1)
+
+/*
+ * Single producer (the interrupt handler), single consumer (the decoder
+ * thread). Each index is only written by its owner, so only acquire/release
+ * ordering is needed, no lock and no syscall.
+ */
+struct pulse_ring {
+    /* producer side */
+    unsigned int head __attribute__((aligned(64)));
+    unsigned int overflows;
+    unsigned int high_water;
+
+    /* consumer side */
+    unsigned int tail __attribute__((aligned(64)));
+
+    struct pulse pulses[PULSE_RING_SIZE] __attribute__((aligned(64)));
+};
+
+static inline void pulse_ring_init(struct pulse_ring *ring) {
+    memset(ring, 0, sizeof(struct pulse_ring));
+}
+
+static inline int pulse_ring_push(struct pulse_ring *ring, unsigned int type,
+        unsigned int duration, unsigned int timestamp) {
+    unsigned int head, tail, fill;
+    struct pulse *pulse;
+
+    head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+    fill = head - tail;
+    if (fill == PULSE_RING_SIZE) {
+        __atomic_store_n(&ring->overflows, ring->overflows + 1,
+                __ATOMIC_RELAXED);
+        return -1;
+    }
+
+    pulse = &ring->pulses[head & PULSE_RING_MASK];
+    pulse->type = type;
+    pulse->duration = duration;
+    pulse->timestamp = timestamp;
+
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+
+    if (++fill > ring->high_water) {
+        __atomic_store_n(&ring->high_water, fill, __ATOMIC_RELAXED);
+    }
+
+    return 0;
+}
+
+/* for the producers able to wait instead of dropping edges */
+static inline int pulse_ring_full(struct pulse_ring *ring) {
+    return __atomic_load_n(&ring->head, __ATOMIC_RELAXED) -
+        __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == PULSE_RING_SIZE;
+}
+
+static inline unsigned int pulse_ring_pop(struct pulse_ring *ring,
+        struct pulse *pulses, unsigned int max) {
+    unsigned int head, tail, count, i;
+
+    tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+    count = head - tail;
+    if (count > max) {
+        count = max;
+    }
+
+    for (i = 0; i != count; i++) {
+        pulses[i] = ring->pulses[(tail + i) & PULSE_RING_MASK];
+    }
+
+    __atomic_store_n(&ring->tail, tail + count, __ATOMIC_RELEASE);
+
+    return count;
+}
+
+static inline unsigned int pulse_ring_overflows(struct pulse_ring *ring) {
+    return __atomic_load_n(&ring->overflows, __ATOMIC_RELAXED);
+}
+
+static inline unsigned int pulse_ring_high_water(struct pulse_ring *ring) {
+    return __atomic_load_n(&ring->high_water, __ATOMIC_RELAXED);
+}
+
+#endif
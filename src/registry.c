@@ -0,0 +1,224 @@
+/*
+ * Copyright (C) 2014 Sylvain Afchain
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libconfig.h>
+
+#include "registry.h"
+
+/* the key of a device answering on every receiver of its remote */
+#define ANY_RECEIVER 0xff
+
+static unsigned long long device_key(int protocol, unsigned int address,
+        int receiver) {
+    return 1ULL << 63 | (unsigned long long) protocol << 40 |
+        (unsigned long long) (receiver == -1 ? ANY_RECEIVER : receiver) << 32 |
+        address;
+}
+
+static struct registry_slot *key_slot(const struct registry *registry,
+        unsigned long long key) {
+    unsigned int i = (key * 0x9e3779b97f4a7c15ULL) >> 32 & registry->mask;
+
+    while (registry->slots[i].key && registry->slots[i].key != key) {
+        i = (i + 1) & registry->mask;
+    }
+
+    return &registry->slots[i];
+}
+
+void registry_free(struct registry *registry) {
+    unsigned int i;
+
+    if (registry == NULL) {
+        return;
+    }
+    for (i = 0; i != registry->count; i++) {
+        free(registry->devices[i].name);
+        free(registry->devices[i].action);
+    }
+    free(registry->devices);
+    free(registry->slots);
+    free(registry);
+}
+
+static int find_protocol(const char *name) {
+    int i;
+
+    for (i = 0; i != PROTOCOL_COUNT; i++) {
+        if (strcmp(protocols[i].name, name) == 0) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static int load_device(const config_setting_t *setting,
+        struct registry_device *device) {
+    const char *protocol, *name, *action = NULL;
+    int address, receiver = -1;
+
+    if (! config_setting_lookup_string(setting, "name", &name) ||
+            ! config_setting_lookup_string(setting, "protocol", &protocol) ||
+            ! config_setting_lookup_int(setting, "address", &address)) {
+        fprintf(stderr, "A device needs a name, a protocol and an address\n");
+        return -1;
+    }
+    config_setting_lookup_string(setting, "action", &action);
+    config_setting_lookup_int(setting, "receiver", &receiver);
+
+    if ((device->protocol = find_protocol(protocol)) == -1) {
+        fprintf(stderr, "Unknown protocol of %s: %s\n", name, protocol);
+        return -1;
+    }
+    if (address < 0 || (device->protocol == PROTOCOL_SRTS &&
+                address > 0xffffff) || (device->protocol == PROTOCOL_HOMEASY &&
+                address > HOMEASY_ADDRESS_MAX) || receiver < -1 ||
+            receiver >= HOMEASY_RECEIVERS ||
+            (device->protocol == PROTOCOL_SRTS && receiver != -1)) {
+        fprintf(stderr, "Invalid address or receiver of %s\n", name);
+        return -1;
+    }
+    device->address = address;
+    device->receiver = receiver;
+
+    device->name = strdup(name);
+    device->action = action ? strdup(action) : NULL;
+    if (device->name == NULL || (action && device->action == NULL)) {
+        fprintf(stderr, "Memory allocation error\n");
+        exit(-1);
+    }
+
+    return 0;
+}
+
+static struct registry *registry_alloc(unsigned int count) {
+    struct registry *registry;
+    unsigned int size = 16;
+
+    while (size < count * 2) {
+        size *= 2;
+    }
+
+    if ((registry = (struct registry *) calloc(1,
+                    sizeof(struct registry))) == NULL ||
+            (registry->slots = (struct registry_slot *) calloc(size,
+                    sizeof(struct registry_slot))) == NULL ||
+            (registry->devices = (struct registry_device *) calloc(
+                    count + 1, sizeof(struct registry_device))) == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        exit(-1);
+    }
+    registry->mask = size - 1;
+    registry->verbose = -1;
+    registry->gpio = -1;
+
+    return registry;
+}
+
+/* the whole file or nothing, NULL on any error */
+struct registry *registry_load(const char *path) {
+    struct registry_device *device;
+    struct registry_slot *slot;
+    struct registry *registry;
+    config_setting_t *devices;
+    unsigned long long key;
+    unsigned int count, i;
+    config_t config;
+
+    config_init(&config);
+    if (! config_read_file(&config, path)) {
+        fprintf(stderr, "%s:%d: %s\n", path, config_error_line(&config),
+                config_error_text(&config));
+        config_destroy(&config);
+        return NULL;
+    }
+
+    devices = config_lookup(&config, "devices");
+    count = devices ? config_setting_length(devices) : 0;
+    registry = registry_alloc(count);
+
+    config_lookup_int(&config, "verbose", &registry->verbose);
+    config_lookup_int(&config, "gpio", &registry->gpio);
+
+    for (i = 0; i != count; i++) {
+        device = &registry->devices[registry->count];
+        if (load_device(config_setting_get_elem(devices, i), device) == -1) {
+            goto error;
+        }
+        registry->count++;
+
+        key = device_key(device->protocol, device->address, device->receiver);
+        slot = key_slot(registry, key);
+        if (slot->key) {
+            fprintf(stderr, "%s and %s are the same device\n",
+                    registry->devices[slot->device].name, device->name);
+            goto error;
+        }
+        slot->key = key;
+        slot->device = i;
+    }
+    config_destroy(&config);
+
+    return registry;
+
+error:
+    fprintf(stderr, "Invalid device %u of %s\n", i + 1, path);
+    config_destroy(&config);
+    registry_free(registry);
+
+    return NULL;
+}
+
+static const struct registry_device *find(const struct registry *registry,
+        int protocol, unsigned int address, int receiver) {
+    struct registry_slot *slot;
+
+    slot = key_slot(registry, device_key(protocol, address, receiver));
+    if (! slot->key) {
+        return NULL;
+    }
+
+    return &registry->devices[slot->device];
+}
+
+/* the device of a frame, its own receiver first, then the whole remote */
+const struct registry_device *registry_lookup(const struct registry *registry,
+        const struct frame *frame) {
+    const struct registry_device *device;
+    const struct homeasy_frame *homeasy;
+    const struct srts_payload *payload;
+
+    switch (frame->protocol) {
+        case PROTOCOL_SRTS:
+            payload = &frame->srts;
+            return find(registry, PROTOCOL_SRTS, payload->address.byte1 |
+                    payload->address.byte2 << 8 | payload->address.byte3 << 16,
+                    -1);
+        case PROTOCOL_HOMEASY:
+            homeasy = &frame->homeasy;
+            if (! homeasy->group && (device = find(registry, PROTOCOL_HOMEASY,
+                            homeasy->address, homeasy->receiver)) != NULL) {
+                return device;
+            }
+            return find(registry, PROTOCOL_HOMEASY, homeasy->address, -1);
+    }
+
+    return NULL;
+}
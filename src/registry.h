@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2014 Sylvain Afchain
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef __REGISTRY_H__
+#define __REGISTRY_H__
+
+#include "protocol.h"
+
+#define REGISTRY_FILE "/etc/domiotools/signal_eventd.cfg"
+
+/*
+ * The devices known to signal_eventd, from a libconfig file:
+ *
+ *   verbose = 1;
+ *   gpio = 2;
+ *   devices = (
+ *     { name = "living room"; protocol = "somfy"; address = 0xbeef; },
+ *     { name = "garden"; protocol = "homeasy"; address = 1234567;
+ *       receiver = 3; action = "lights"; }
+ *   );
+ *
+ * A homeasy device without a receiver matches every receiver of the remote,
+ * group frames included.
+ */
+struct registry_device {
+    int protocol;
+    unsigned int address;
+    /* -1 for any */
+    int receiver;
+    char *name;
+    /* NULL when none */
+    char *action;
+};
+
+struct registry_slot {
+    /* 0 when empty */
+    unsigned long long key;
+    unsigned int device;
+};
+
+/*
+ * Never changed once loaded, a new one replaces it as a whole, so readers
+ * need no lock. Open addressing with linear probing, at most half full.
+ */
+struct registry {
+    unsigned int mask;
+    struct registry_slot *slots;
+
+    unsigned int count;
+    struct registry_device *devices;
+
+    /* -1 when not set by the file */
+    int verbose;
+    int gpio;
+};
+
+struct registry *registry_load(const char *path);
+void registry_free(struct registry *registry);
+const struct registry_device *registry_lookup(const struct registry *registry,
+        const struct frame *frame);
+
+#endif
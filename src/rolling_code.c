@@ -0,0 +1,238 @@
+/*
+ * Copyright (C) 2014 Sylvain Afchain
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <libgen.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+
+#include "common.h"
+#include "rolling_code.h"
+
+#define HEADER_SIZE 4096
+#define TABLE_SIZE (HEADER_SIZE + ROLLING_CODE_SLOTS * sizeof(unsigned int))
+
+/* import the /var/lib/<legacy>/<address> files of the previous releases */
+static void migrate_legacy(struct rolling_code_table *table,
+        const char *legacy) {
+    char path[PATH_MAX], code[10];
+    struct dirent *entry;
+    long int address;
+    char *end;
+    FILE *fp;
+    DIR *dir;
+
+    snprintf(path, sizeof(path), "/var/lib/%s", legacy);
+    if ((dir = opendir(path)) == NULL) {
+        return;
+    }
+
+    while ((entry = readdir(dir)) != NULL) {
+        address = strtol(entry->d_name, &end, 10);
+        if (*end != '\0' || end == entry->d_name || address <= 0 ||
+                address >= ROLLING_CODE_SLOTS) {
+            continue;
+        }
+
+        snprintf(path, sizeof(path), "/var/lib/%s/%s", legacy, entry->d_name);
+        if ((fp = fopen(path, "r")) == NULL) {
+            continue;
+        }
+        memset(code, 0, sizeof(code));
+        if (fgets(code, sizeof(code), fp) != NULL) {
+            table->slots[address] = ROLLING_CODE_USED |
+                    (atoi(code) & ROLLING_CODE_MASK);
+        }
+        fclose(fp);
+    }
+    closedir(dir);
+}
+
+int rolling_code_open(struct rolling_code_table *table, const char *path,
+        const char *legacy, int sync) {
+    char *copy;
+    struct stat st;
+    void *map;
+    int fd;
+
+    memset(table, 0, sizeof(struct rolling_code_table));
+
+    copy = strdup(path);
+    if (copy == NULL || mkpath(dirname(copy), 0755) == -1) {
+        fprintf(stderr, "Unable to create the state path: %s\n", path);
+        free(copy);
+        return -1;
+    }
+    free(copy);
+
+    if ((fd = open(path, O_RDWR | O_CREAT, 0644)) == -1) {
+        fprintf(stderr, "Unable to open the state file: %s\n", path);
+        return -1;
+    }
+
+    /* only the creation needs to be serialized, the slots are atomic */
+    if (flock(fd, LOCK_EX) == -1 || fstat(fd, &st) == -1) {
+        close(fd);
+        return -1;
+    }
+
+    if (st.st_size == 0 && ftruncate(fd, TABLE_SIZE) == -1) {
+        fprintf(stderr, "Unable to size the state file: %s\n", path);
+        close(fd);
+        return -1;
+    } else if (st.st_size != 0 && st.st_size != TABLE_SIZE) {
+        fprintf(stderr, "Corrupted state file: %s\n", path);
+        close(fd);
+        return -1;
+    }
+
+    map = mmap(NULL, TABLE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "Unable to map the state file: %s\n", path);
+        close(fd);
+        return -1;
+    }
+
+    table->fd = fd;
+    table->sync = sync;
+    table->header = (struct rolling_code_header *) map;
+    table->slots = (unsigned int *) ((char *) map + HEADER_SIZE);
+    table->dirty_min = ROLLING_CODE_SLOTS;
+    table->dirty_max = 0;
+
+    /* new table, or one whose creation was interrupted */
+    if (table->header->magic[0] == '\0') {
+        if (legacy != NULL) {
+            migrate_legacy(table, legacy);
+        }
+
+        /* the header goes last, a table without one is created again */
+        if (msync(map, TABLE_SIZE, MS_SYNC) == -1) {
+            rolling_code_close(table);
+            return -1;
+        }
+        memcpy(table->header->magic, ROLLING_CODE_MAGIC, 4);
+        table->header->version = ROLLING_CODE_VERSION;
+        table->header->slots = ROLLING_CODE_SLOTS;
+        msync(map, HEADER_SIZE, MS_SYNC);
+    } else if (memcmp(table->header->magic, ROLLING_CODE_MAGIC, 4) != 0 ||
+            table->header->version != ROLLING_CODE_VERSION ||
+            table->header->slots != ROLLING_CODE_SLOTS) {
+        fprintf(stderr, "Not a rolling code table: %s\n", path);
+        rolling_code_close(table);
+        return -1;
+    }
+
+    flock(fd, LOCK_UN);
+
+    return 0;
+}
+
+static int sync_slots(struct rolling_code_table *table, unsigned int first,
+        unsigned int last) {
+    long page = sysconf(_SC_PAGESIZE);
+    unsigned long start, end;
+
+    start = (unsigned long) &table->slots[first] & ~(page - 1);
+    end = (unsigned long) &table->slots[last + 1];
+
+    return msync((void *) start, end - start, MS_SYNC);
+}
+
+/*
+ * Returns the code to use for the address and stores it at once, so that a
+ * crash during the transmission can never make a code be sent twice.
+ */
+static unsigned short advance(struct rolling_code_table *table,
+        unsigned short address) {
+    unsigned int slot, code;
+
+    slot = __atomic_load_n(&table->slots[address], __ATOMIC_RELAXED);
+    do {
+        if (slot & ROLLING_CODE_USED) {
+            code = (slot + 1) & ROLLING_CODE_MASK;
+        } else {
+            code = 1;
+        }
+    } while (! __atomic_compare_exchange_n(&table->slots[address], &slot,
+            ROLLING_CODE_USED | code, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+
+    if (address < table->dirty_min) {
+        table->dirty_min = address;
+    }
+    if (address > table->dirty_max) {
+        table->dirty_max = address;
+    }
+
+    return code;
+}
+
+unsigned short rolling_code_reserve(struct rolling_code_table *table,
+        unsigned short address) {
+    unsigned short code;
+
+    code = advance(table, address);
+    if (table->sync == ROLLING_CODE_SYNC_EACH) {
+        rolling_code_flush(table);
+    }
+
+    return code;
+}
+
+/* the codes of a whole group, written back at once whatever the sync mode */
+void rolling_code_reserve_group(struct rolling_code_table *table,
+        const unsigned short *addresses, unsigned short *codes,
+        unsigned int count) {
+    unsigned int i;
+
+    for (i = 0; i != count; i++) {
+        codes[i] = advance(table, addresses[i]);
+    }
+    rolling_code_flush(table);
+}
+
+/* write back every slot reserved since the last flush */
+int rolling_code_flush(struct rolling_code_table *table) {
+    int rtv;
+
+    if (table->dirty_min > table->dirty_max) {
+        return 0;
+    }
+
+    rtv = sync_slots(table, table->dirty_min, table->dirty_max);
+    table->dirty_min = ROLLING_CODE_SLOTS;
+    table->dirty_max = 0;
+
+    return rtv;
+}
+
+void rolling_code_close(struct rolling_code_table *table) {
+    if (table->header != NULL) {
+        rolling_code_flush(table);
+        munmap(table->header, TABLE_SIZE);
+    }
+    close(table->fd);
+    memset(table, 0, sizeof(struct rolling_code_table));
+    table->fd = -1;
+}
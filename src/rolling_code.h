@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2014 Sylvain Afchain
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef __ROLLING_CODE_H__
+#define __ROLLING_CODE_H__
+
+#define ROLLING_CODE_TABLE "/var/lib/domiotools/rolling_codes"
+#define ROLLING_CODE_MAGIC "RCTB"
+#define ROLLING_CODE_VERSION 1
+
+/* one slot per 16 bits address, indexed directly */
+#define ROLLING_CODE_SLOTS 65536
+#define ROLLING_CODE_USED 0x10000
+#define ROLLING_CODE_MASK 0xffff
+
+enum ROLLING_CODE_SYNC {
+    /* written back by the kernel or by rolling_code_flush */
+    ROLLING_CODE_SYNC_LAZY = 0,
+    /* every reservation is on disk before being returned */
+    ROLLING_CODE_SYNC_EACH
+};
+
+struct rolling_code_header {
+    char magic[4];
+    unsigned int version;
+    unsigned int slots;
+};
+
+/*
+ * The table is a header page followed by the slots, mapped shared so that
+ * every process using it sees the same codes. A slot is a single 32 bits
+ * word updated with an atomic compare and swap.
+ */
+struct rolling_code_table {
+    int fd;
+    int sync;
+    struct rolling_code_header *header;
+    unsigned int *slots;
+    unsigned int dirty_min;
+    unsigned int dirty_max;
+};
+
+int rolling_code_open(struct rolling_code_table *table, const char *path,
+        const char *legacy, int sync);
+unsigned short rolling_code_reserve(struct rolling_code_table *table,
+        unsigned short address);
+void rolling_code_reserve_group(struct rolling_code_table *table,
+        const unsigned short *addresses, unsigned short *codes,
+        unsigned int count);
+int rolling_code_flush(struct rolling_code_table *table);
+void rolling_code_close(struct rolling_code_table *table);
+
+#endif
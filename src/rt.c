@@ -0,0 +1,343 @@
+/*
+ * Copyright (C) 2014 Sylvain Afchain
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include "rt.h"
+#include "histogram.h"
+
+static const char *role_names[RT_ROLES] = {
+    "main", "isr", "reader", "decoder", "transmit"
+};
+
+static const struct {
+    const char *name;
+    int policy;
+} policies[] = {
+    { "other", SCHED_OTHER },
+    { "batch", SCHED_BATCH },
+    { "fifo", SCHED_FIFO },
+    { "rr", SCHED_RR },
+};
+
+#define POLICIES (sizeof(policies) / sizeof(policies[0]))
+
+/*
+ * What piHiPri() used to give everyone, round robin, the transmitter on top,
+ * then the edges from the pin, down to the main loop that only sleeps.
+ */
+void rt_init(struct rt_config *config) {
+    static const int priorities[RT_ROLES] = { 0, 90, 70, 80, 99 };
+    int i;
+
+    memset(config, 0, sizeof(struct rt_config));
+    for (i = 0; i != RT_ROLES; i++) {
+        config->roles[i].policy = i == RT_MAIN ? SCHED_OTHER : SCHED_RR;
+        config->roles[i].priority = priorities[i];
+    }
+    config->lock_memory = 1;
+}
+
+static int parse_cpus(char *list, cpu_set_t *cpus) {
+    char *cpu, *end;
+    long int a2i;
+
+    CPU_ZERO(cpus);
+    for (cpu = strtok(list, ","); cpu != NULL; cpu = strtok(NULL, ",")) {
+        a2i = strtol(cpu, &end, 10);
+        if (*end != '\0' || end == cpu || a2i < 0 || a2i >= CPU_SETSIZE) {
+            return -1;
+        }
+        CPU_SET(a2i, cpus);
+    }
+
+    return CPU_COUNT(cpus) ? 0 : -1;
+}
+
+/* <role>=<policy>[:<priority>][@<cpu>[,<cpu>]...], or nomlock */
+int rt_parse(struct rt_config *config, const char *spec) {
+    char buffer[128], *policy, *priority, *cpus, *end;
+    struct rt_role role;
+    long int a2i;
+    int i, p;
+
+    if (strcmp(spec, "nomlock") == 0) {
+        config->lock_memory = 0;
+        return 0;
+    }
+
+    if (strlen(spec) >= sizeof(buffer)) {
+        return -1;
+    }
+    strcpy(buffer, spec);
+    if ((policy = strchr(buffer, '=')) == NULL) {
+        return -1;
+    }
+    *policy++ = '\0';
+
+    for (i = 0; i != RT_ROLES && strcmp(buffer, role_names[i]); i++);
+    if (i == RT_ROLES) {
+        return -1;
+    }
+    role = config->roles[i];
+
+    if ((cpus = strchr(policy, '@')) != NULL) {
+        *cpus++ = '\0';
+        if (parse_cpus(cpus, &role.cpus) == -1) {
+            return -1;
+        }
+        role.pinned = 1;
+    }
+    if ((priority = strchr(policy, ':')) != NULL) {
+        *priority++ = '\0';
+    }
+
+    /* the affinity alone keeps the policy */
+    if (*policy != '\0') {
+        for (p = 0; p != POLICIES && strcmp(policy, policies[p].name); p++);
+        if (p == POLICIES) {
+            return -1;
+        }
+        role.policy = policies[p].policy;
+        role.priority = 0;
+    }
+
+    if (priority != NULL) {
+        a2i = strtol(priority, &end, 10);
+        if (*end != '\0' || end == priority ||
+                a2i < sched_get_priority_min(role.policy) ||
+                a2i > sched_get_priority_max(role.policy)) {
+            return -1;
+        }
+        role.priority = a2i;
+    } else if (role.policy == SCHED_FIFO || role.policy == SCHED_RR) {
+        role.priority = sched_get_priority_max(role.policy);
+    }
+
+    config->roles[i] = role;
+
+    return 0;
+}
+
+void rt_usage(FILE *fp) {
+    fprintf(fp, "--rt <role>=[<policy>][:<priority>][@<cpu>[,<cpu>]...], "
+            "role: main|isr|reader|decoder|transmit, "
+            "policy: other|batch|fifo|rr, or --rt nomlock\n");
+}
+
+/*
+ * Nothing of ours is paged out nor faulted in later, and the heap is never
+ * given back to the kernel, a page fault there would cost a deadline.
+ */
+int rt_lock_memory(struct rt_config *config) {
+    if (! config->lock_memory) {
+        return 0;
+    }
+
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) == -1) {
+        perror("mlockall");
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * The mappings made in between are neither locked nor faulted in at once,
+ * for the large files only touched a page at a time. Whatever was locked
+ * stays so.
+ */
+void rt_suspend_lock(struct rt_config *config) {
+    if (config->lock_memory) {
+        mlockall(MCL_CURRENT);
+    }
+}
+
+void rt_resume_lock(struct rt_config *config) {
+    if (config->lock_memory) {
+        mlockall(MCL_FUTURE);
+    }
+}
+
+static void prefault_stack(void) {
+    volatile unsigned char stack[RT_STACK_PREFAULT];
+    unsigned int i;
+
+    for (i = 0; i < sizeof(stack); i += 4096) {
+        stack[i] = 0;
+    }
+}
+
+/* the calling thread takes the policy and the cpus of its role */
+int rt_apply(struct rt_config *config, int role) {
+    struct rt_role *r = &config->roles[role];
+    struct sched_param param;
+    int rtv = 0;
+
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = r->priority;
+    if ((errno = pthread_setschedparam(pthread_self(), r->policy,
+                    &param)) != 0) {
+        fprintf(stderr, "Unable to set the scheduling of the %s thread: %s\n",
+                role_names[role], strerror(errno));
+        rtv = -1;
+    }
+
+    if (r->pinned && (errno = pthread_setaffinity_np(pthread_self(),
+                    sizeof(cpu_set_t), &r->cpus)) != 0) {
+        fprintf(stderr, "Unable to pin the %s thread: %s\n", role_names[role],
+                strerror(errno));
+        rtv = -1;
+    }
+
+    prefault_stack();
+
+    return rtv;
+}
+
+/* a small stack, the default one would be locked in memory as a whole */
+int rt_thread_create(pthread_t *thread, void *(*start)(void *), void *arg) {
+    pthread_attr_t attr;
+    int rtv;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, RT_STACK_SIZE);
+    rtv = pthread_create(thread, &attr, start, arg);
+    pthread_attr_destroy(&attr);
+
+    return rtv;
+}
+
+struct latency {
+    struct rt_config *config;
+    int role;
+    int cpu;
+    unsigned long loops;
+    struct histogram histogram;
+    pthread_t thread;
+};
+
+static unsigned long long timespec_ns(struct timespec *ts) {
+    return ts->tv_sec * 1000000000ULL + ts->tv_nsec;
+}
+
+/* as cyclictest does, sleep to an absolute deadline and see how late we are */
+static void *latency_thread(void *arg) {
+    struct latency *latency = (struct latency *) arg;
+    struct rt_config config = *latency->config;
+    struct timespec next, now;
+    unsigned long i;
+
+    config.roles[latency->role].pinned = 1;
+    CPU_ZERO(&config.roles[latency->role].cpus);
+    CPU_SET(latency->cpu, &config.roles[latency->role].cpus);
+    rt_apply(&config, latency->role);
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    for (i = 0; i != latency->loops; i++) {
+        next.tv_nsec += RT_LATENCY_INTERVAL * 1000;
+        if (next.tv_nsec >= 1000000000) {
+            next.tv_nsec -= 1000000000;
+            next.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        histogram_add(&latency->histogram,
+                timespec_ns(&now) - timespec_ns(&next));
+    }
+
+    return NULL;
+}
+
+/*
+ * Wakeup latency of a thread of the given role on each of its cpus, every
+ * cpu online when the role is not pinned. Returns the worst one, in micro
+ * seconds, -1 on error.
+ */
+int rt_latency_test(struct rt_config *config, int role, unsigned int seconds,
+        FILE *fp) {
+    struct rt_role *r = &config->roles[role];
+    struct latency *latencies;
+    struct histogram all;
+    int ncpus, count = 0, cpu, i;
+
+    ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if ((latencies = (struct latency *) calloc(ncpus,
+                    sizeof(struct latency))) == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        exit(-1);
+    }
+
+    fprintf(fp, "wakeup latency of the %s threads, %u us period, %u s\n",
+            role_names[role], RT_LATENCY_INTERVAL, seconds);
+
+    for (cpu = 0; cpu != ncpus; cpu++) {
+        if (r->pinned && ! CPU_ISSET(cpu, &r->cpus)) {
+            continue;
+        }
+        latencies[count].config = config;
+        latencies[count].role = role;
+        latencies[count].cpu = cpu;
+        latencies[count].loops = seconds * (1000000 / RT_LATENCY_INTERVAL);
+        histogram_init(&latencies[count].histogram);
+        if (rt_thread_create(&latencies[count].thread, latency_thread,
+                    &latencies[count]) != 0) {
+            fprintf(stderr, "Unable to start the latency thread on cpu %d\n",
+                    cpu);
+            break;
+        }
+        count++;
+    }
+
+    histogram_init(&all);
+    for (i = 0; i != count; i++) {
+        pthread_join(latencies[i].thread, NULL);
+        fprintf(fp, "cpu %2d: p50 %6.1f us, p99 %6.1f us, max %6.1f us\n",
+                latencies[i].cpu,
+                histogram_percentile(&latencies[i].histogram, 50) / 1000.0,
+                histogram_percentile(&latencies[i].histogram, 99) / 1000.0,
+                latencies[i].histogram.max / 1000.0);
+        histogram_merge(&all, &latencies[i].histogram);
+    }
+    free(latencies);
+
+    if (count == 0) {
+        fprintf(stderr, "No cpu online for the %s threads\n",
+                role_names[role]);
+        return -1;
+    }
+    fprintf(fp, "all   : p50 %6.1f us, p99 %6.1f us, max %6.1f us\n",
+            histogram_percentile(&all, 50) / 1000.0,
+            histogram_percentile(&all, 99) / 1000.0, all.max / 1000.0);
+
+    return all.max / 1000;
+}
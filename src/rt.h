@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2014 Sylvain Afchain
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef __RT_H__
+#define __RT_H__
+
+#include <stdio.h>
+#include <pthread.h>
+#include <sched.h>
+
+/* stack of the threads we create, all of it locked once memory is */
+#define RT_STACK_SIZE (256 * 1024)
+
+/* touched by every tuned thread before its first deadline */
+#define RT_STACK_PREFAULT (64 * 1024)
+
+/* period of the wakeups measured by the latency test, micro seconds */
+#define RT_LATENCY_INTERVAL 1000
+
+enum RT_ROLE {
+    /* the main loop, metrics and housekeeping */
+    RT_MAIN = 0,
+    /* the wiringPi interrupt threads */
+    RT_ISR,
+    /* the threads reading samples, edge events or a serial line */
+    RT_READER,
+    /* the protocol decoders */
+    RT_DECODER,
+    /* the threads playing a timeline on a pin */
+    RT_TRANSMIT,
+    RT_ROLES
+};
+
+struct rt_role {
+    int policy;
+    int priority;
+    /* no affinity set when not pinned */
+    int pinned;
+    cpu_set_t cpus;
+};
+
+struct rt_config {
+    struct rt_role roles[RT_ROLES];
+    int lock_memory;
+};
+
+void rt_init(struct rt_config *config);
+int rt_parse(struct rt_config *config, const char *spec);
+void rt_usage(FILE *fp);
+int rt_lock_memory(struct rt_config *config);
+void rt_suspend_lock(struct rt_config *config);
+void rt_resume_lock(struct rt_config *config);
+int rt_apply(struct rt_config *config, int role);
+int rt_thread_create(pthread_t *thread, void *(*start)(void *), void *arg);
+int rt_latency_test(struct rt_config *config, int role, unsigned int seconds,
+        FILE *fp);
+
+#endif
@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2014 Sylvain Afchain
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <strings.h>
+#include <limits.h>
+
+#include "samples.h"
+
+typedef unsigned char lanes_t __attribute__((vector_size(SAMPLES_LANES)));
+typedef unsigned long long words_t
+    __attribute__((vector_size(SAMPLES_LANES)));
+
+void samples_init(struct samples *samples, int format, unsigned int rate,
+        unsigned char threshold,
+        void (*output)(int type, unsigned int duration, void *arg), void *arg) {
+    memset(samples, 0, sizeof(struct samples));
+    samples->format = format;
+    samples->rate = rate;
+    samples->threshold = threshold;
+    samples->output = output;
+    samples->arg = arg;
+}
+
+int samples_format(const char *name) {
+    if (strcasecmp(name, "u8") == 0) {
+        return SAMPLES_U8;
+    } else if (strcasecmp(name, "bit") == 0) {
+        return SAMPLES_BIT;
+    }
+
+    return SAMPLES_UNKNOWN;
+}
+
+/* the level changes at the given sample, the pulse before it is complete */
+static void edge(struct samples *samples, unsigned long long at) {
+    unsigned long long us, duration;
+
+    /* from the sample clock, so rounding never accumulates */
+    us = at / samples->rate * 1000000 +
+        at % samples->rate * 1000000 / samples->rate;
+
+    if (samples->started) {
+        duration = us - samples->last_us;
+        if (duration > UINT_MAX) {
+            duration = UINT_MAX;
+        }
+        samples->edges++;
+        samples->output(samples->level, duration, samples->arg);
+    }
+    samples->started = 1;
+    samples->last_us = us;
+    samples->level = ! samples->level;
+}
+
+/* lanes not at the current level, zero when no edge in the block */
+static inline int block_has_edge(const unsigned char *p, lanes_t threshold,
+        lanes_t level) {
+    lanes_t v[4], diff;
+    words_t words;
+    int i;
+
+    memcpy(v, p, sizeof(v));
+
+    diff = ((lanes_t) (v[0] >= threshold)) ^ level;
+    for (i = 1; i != 4; i++) {
+        diff |= ((lanes_t) (v[i] >= threshold)) ^ level;
+    }
+    words = (words_t) diff;
+
+    return (words[0] | words[1]) != 0;
+}
+
+/*
+ * Edges are rare compared to the samples, a few per millisecond at several
+ * mega samples per second, so whole blocks are skipped with vector compares
+ * and only the blocks holding an edge are walked sample by sample.
+ */
+static void scan_u8(struct samples *samples, const unsigned char *buffer,
+        size_t len) {
+    lanes_t threshold = { 0 }, level;
+    size_t i = 0, end;
+
+    threshold += samples->threshold;
+
+    while (i != len) {
+        if (len - i >= SAMPLES_BLOCK) {
+            level = (lanes_t) { 0 } - (unsigned char) samples->level;
+            if (! block_has_edge(buffer + i, threshold, level)) {
+                i += SAMPLES_BLOCK;
+                continue;
+            }
+            end = i + SAMPLES_BLOCK;
+        } else {
+            end = len;
+        }
+
+        for (; i != end; i++) {
+            if ((buffer[i] >= samples->threshold) != samples->level) {
+                edge(samples, samples->position + i);
+            }
+        }
+    }
+}
+
+/* bits left aligned in word, the edges found with a count of leading zeros */
+static void scan_word(struct samples *samples, unsigned long long word,
+        unsigned int bits, unsigned long long at) {
+    unsigned long long valid = ~0ULL << (64 - bits), diff;
+    unsigned int n;
+
+    while (1) {
+        diff = (word ^ (samples->level ? ~0ULL : 0)) & valid;
+        if (diff == 0) {
+            return;
+        }
+        n = __builtin_clzll(diff);
+        edge(samples, at + n);
+
+        if (n == 63) {
+            return;
+        }
+        valid &= ~0ULL >> (n + 1);
+    }
+}
+
+static void scan_bit(struct samples *samples, const unsigned char *buffer,
+        size_t len) {
+    unsigned long long word;
+    size_t i = 0;
+
+    for (; len - i >= 8; i += 8) {
+        memcpy(&word, buffer + i, 8);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        word = __builtin_bswap64(word);
+#endif
+        /* a whole word at the current level, the common case */
+        if (word == (samples->level ? ~0ULL : 0)) {
+            continue;
+        }
+        scan_word(samples, word, 64, samples->position + i * 8);
+    }
+
+    for (; i != len; i++) {
+        scan_word(samples, (unsigned long long) buffer[i] << 56, 8,
+                samples->position + i * 8);
+    }
+}
+
+void samples_scan(struct samples *samples, const unsigned char *buffer,
+        size_t len) {
+    if (samples->format == SAMPLES_BIT) {
+        scan_bit(samples, buffer, len);
+        samples->position += len * 8;
+    } else {
+        scan_u8(samples, buffer, len);
+        samples->position += len;
+    }
+}
+
+/* end of stream, the pulse still running is complete */
+void samples_flush(struct samples *samples) {
+    if (samples->started) {
+        edge(samples, samples->position);
+    }
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2014 Sylvain Afchain
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef __SAMPLES_H__
+#define __SAMPLES_H__
+
+#include <stddef.h>
+
+/* sample bytes checked at once for an edge */
+#define SAMPLES_LANES 16
+#define SAMPLES_BLOCK (SAMPLES_LANES * 4)
+
+enum SAMPLES_FORMAT {
+    /* one byte per sample, high when at or above the threshold */
+    SAMPLES_U8 = 0,
+    /* eight samples per byte, the first one in the most significant bit */
+    SAMPLES_BIT,
+    SAMPLES_UNKNOWN
+};
+
+/*
+ * Turns a stream of samples taken at a fixed rate into pulses, the level
+ * ending and its duration in micro seconds, as the edge sources do. The
+ * stream may be cut anywhere, the state is kept from one buffer to the next.
+ */
+struct samples {
+    int format;
+    unsigned int rate;
+    unsigned char threshold;
+
+    int level;
+    int started;
+    unsigned long long position;
+    unsigned long long last_us;
+
+    void (*output)(int type, unsigned int duration, void *arg);
+    void *arg;
+
+    unsigned long edges;
+};
+
+void samples_init(struct samples *samples, int format, unsigned int rate,
+        unsigned char threshold,
+        void (*output)(int type, unsigned int duration, void *arg), void *arg);
+void samples_scan(struct samples *samples, const unsigned char *buffer,
+        size_t len);
+void samples_flush(struct samples *samples);
+int samples_format(const char *name);
+
+#endif
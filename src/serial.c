@@ -0,0 +1,293 @@
+/*
+ * Copyright (C) 2014 Sylvain Afchain
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <termios.h>
+
+#include "serial.h"
+
+/* CRC-8, polynomial 0x07, the board computes the same one */
+unsigned char serial_crc8(const unsigned char *buffer, unsigned int len) {
+    unsigned char crc = 0;
+    unsigned int i, b;
+
+    for (i = 0; i != len; i++) {
+        crc ^= buffer[i];
+        for (b = 0; b != 8; b++) {
+            crc = crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1;
+        }
+    }
+
+    return crc;
+}
+
+static void put16(unsigned char *p, unsigned int value) {
+    p[0] = value;
+    p[1] = value >> 8;
+}
+
+static void put32(unsigned char *p, unsigned int value) {
+    put16(p, value);
+    put16(p + 2, value >> 16);
+}
+
+static unsigned int get16(const unsigned char *p) {
+    return p[0] | p[1] << 8;
+}
+
+static unsigned int get32(const unsigned char *p) {
+    return get16(p) | get16(p + 2) << 16;
+}
+
+void serial_pack_command(const struct serial_command *command,
+        unsigned char *buffer) {
+    buffer[0] = SERIAL_COMMAND_MAGIC;
+    buffer[1] = command->protocol;
+    buffer[2] = command->flags;
+    buffer[3] = command->seq;
+    put32(buffer + 4, command->address);
+    buffer[8] = command->command;
+    buffer[9] = command->key;
+    buffer[10] = command->receiver;
+    put16(buffer + 11, command->code);
+    buffer[13] = command->frames;
+    buffer[14] = serial_crc8(buffer, SERIAL_COMMAND_SIZE - 1);
+}
+
+/* returns -1 when the buffer does not hold a valid command */
+int serial_unpack_command(const unsigned char *buffer,
+        struct serial_command *command) {
+    if (buffer[0] != SERIAL_COMMAND_MAGIC || buffer[SERIAL_COMMAND_SIZE - 1] !=
+            serial_crc8(buffer, SERIAL_COMMAND_SIZE - 1)) {
+        return -1;
+    }
+
+    command->protocol = buffer[1];
+    command->flags = buffer[2];
+    command->seq = buffer[3];
+    command->address = get32(buffer + 4);
+    command->command = buffer[8];
+    command->key = buffer[9];
+    command->receiver = buffer[10];
+    command->code = get16(buffer + 11);
+    command->frames = buffer[13];
+
+    return 0;
+}
+
+void serial_pack_ack(const struct serial_ack *ack, unsigned char *buffer) {
+    buffer[0] = SERIAL_ACK_MAGIC;
+    buffer[1] = ack->seq;
+    buffer[2] = ack->status;
+    buffer[3] = ack->frames;
+    put32(buffer + 4, ack->airtime);
+    put16(buffer + 8, ack->late);
+    buffer[10] = serial_crc8(buffer, SERIAL_ACK_SIZE - 1);
+}
+
+/* returns -1 when the buffer does not hold a valid ack */
+int serial_unpack_ack(const unsigned char *buffer, struct serial_ack *ack) {
+    if (buffer[0] != SERIAL_ACK_MAGIC || buffer[SERIAL_ACK_SIZE - 1] !=
+            serial_crc8(buffer, SERIAL_ACK_SIZE - 1)) {
+        return -1;
+    }
+
+    ack->seq = buffer[1];
+    ack->status = buffer[2];
+    ack->frames = buffer[3];
+    ack->airtime = get32(buffer + 4);
+    ack->late = get16(buffer + 8);
+
+    return 0;
+}
+
+/* raw 115200 bauds 8N1, reads never block */
+int serial_open(const char *path) {
+    struct termios tio;
+    int fd;
+
+    if ((fd = open(path, O_RDWR | O_NOCTTY)) == -1) {
+        perror(path);
+        return -1;
+    }
+
+    /* a recorded stream, read as it is */
+    if (! isatty(fd)) {
+        return fd;
+    }
+
+    if (tcgetattr(fd, &tio) == -1) {
+        perror("tcgetattr");
+        close(fd);
+        return -1;
+    }
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, B115200);
+    cfsetospeed(&tio, B115200);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+    if (tcsetattr(fd, TCSANOW, &tio) == -1) {
+        perror("tcsetattr");
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static long long now_ms(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+/*
+ * Wait for the next valid ack, any byte before its magic or a message with a
+ * wrong CRC is skipped. Returns -1 on timeout.
+ */
+int serial_read_ack(int fd, struct serial_ack *ack, int timeout_ms) {
+    unsigned char buffer[SERIAL_ACK_SIZE];
+    struct pollfd pfd;
+    long long deadline = now_ms() + timeout_ms;
+    int len = 0, left, rtv, i;
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+
+    while ((left = deadline - now_ms()) > 0) {
+        if ((rtv = poll(&pfd, 1, left)) <= 0) {
+            continue;
+        }
+        if ((rtv = read(fd, buffer + len, SERIAL_ACK_SIZE - len)) <= 0) {
+            return -1;
+        }
+        len += rtv;
+
+        while (len > 0) {
+            for (i = 0; i != len && buffer[i] != SERIAL_ACK_MAGIC; i++);
+            if (i != 0) {
+                memmove(buffer, buffer + i, len - i);
+                len -= i;
+                continue;
+            }
+            if (len != SERIAL_ACK_SIZE) {
+                break;
+            }
+            if (serial_unpack_ack(buffer, ack) == 0) {
+                return 0;
+            }
+
+            /* not an ack after all, look for the next magic */
+            memmove(buffer, buffer + 1, --len);
+        }
+    }
+
+    return -1;
+}
+
+static int write_all(int fd, const unsigned char *buffer, int len) {
+    int rtv;
+
+    while (len > 0) {
+        if ((rtv = write(fd, buffer, len)) <= 0) {
+            return -1;
+        }
+        buffer += rtv;
+        len -= rtv;
+    }
+
+    return 0;
+}
+
+/*
+ * Wait for the ack of seq, returns 1 when the board announces it just booted
+ * instead, -1 on timeout.
+ */
+static int wait_ack(int fd, unsigned char seq, struct serial_ack *ack,
+        int timeout_ms) {
+    while (serial_read_ack(fd, ack, timeout_ms) == 0) {
+        if (ack->status == SERIAL_READY) {
+            return 1;
+        }
+        if (ack->seq == seq) {
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+/*
+ * Send a command and wait for its frames to be transmitted. The command is
+ * sent again until the board accepts it, the board ignores a sequence number
+ * it has already accepted so that a train is never transmitted twice.
+ * Returns 0 once done, ack holding the timing measured by the board, -1
+ * otherwise.
+ */
+int serial_transmit(int fd, struct serial_command *command,
+        struct serial_ack *ack, int timeout_ms) {
+    unsigned char buffer[SERIAL_COMMAND_SIZE];
+    long long deadline;
+    int rtv;
+
+    serial_pack_command(command, buffer);
+
+    deadline = now_ms() + SERIAL_BOOT_MS;
+    while (1) {
+        if (write_all(fd, buffer, SERIAL_COMMAND_SIZE) == -1) {
+            perror("write");
+            return -1;
+        }
+
+        rtv = wait_ack(fd, command->seq, ack, SERIAL_ACCEPT_MS);
+        if (rtv == 0 && ack->status == SERIAL_ACCEPTED) {
+            break;
+        }
+        /* the accepted ack was lost but the train went out */
+        if (rtv == 0 && ack->status == SERIAL_DONE) {
+            return 0;
+        }
+        if (rtv == 0 && ack->status == SERIAL_BAD_COMMAND) {
+            fprintf(stderr, "Command rejected by the transmitter\n");
+            return -1;
+        }
+        if (now_ms() >= deadline) {
+            fprintf(stderr, "No answer from the transmitter\n");
+            return -1;
+        }
+    }
+
+    while ((rtv = wait_ack(fd, command->seq, ack, timeout_ms)) == 0) {
+        if (ack->status == SERIAL_DONE) {
+            return 0;
+        }
+    }
+    if (rtv == 1) {
+        fprintf(stderr, "Transmitter reset during the transmission\n");
+    } else {
+        fprintf(stderr, "Transmission not acknowledged\n");
+    }
+
+    return -1;
+}
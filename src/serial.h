@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2014 Sylvain Afchain
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef __SERIAL_H__
+#define __SERIAL_H__
+
+/*
+ * Binary protocol of the Arduino transmit coprocessor, see arduino/srts.ino.
+ * The host sends a command, the board answers at once with an accepted ack,
+ * renders the frames with its timer and answers again with a done ack
+ * carrying the timing it measured. Multi byte fields are little endian, the
+ * last byte of every message is a CRC-8 of the previous ones.
+ *
+ * command: magic, protocol, flags, seq, address (4), command, key, receiver,
+ *          code (2), frames, crc
+ * ack:     magic, seq, status, frames, airtime us (4), late us (2), crc
+ */
+#define SERIAL_COMMAND_MAGIC 0xd7
+#define SERIAL_ACK_MAGIC 0xa7
+#define SERIAL_COMMAND_SIZE 15
+#define SERIAL_ACK_SIZE 11
+
+/* the board resets when the port is opened, its boot loader takes a while */
+#define SERIAL_BOOT_MS 2500
+/* resend period of a command not accepted yet */
+#define SERIAL_ACCEPT_MS 250
+
+enum SERIAL_FLAGS {
+    /* no wakeup, the first frame is sent as a repeat */
+    SERIAL_REPEATED = 1,
+    /* homeasy group frame */
+    SERIAL_GROUP = 2
+};
+
+enum SERIAL_STATUS {
+    SERIAL_READY = 0,
+    SERIAL_ACCEPTED,
+    SERIAL_DONE,
+    SERIAL_BAD_CRC,
+    SERIAL_BAD_COMMAND
+};
+
+struct serial_command {
+    unsigned char protocol;
+    unsigned char flags;
+    unsigned char seq;
+    unsigned int address;
+    unsigned char command;
+    unsigned char key;
+    unsigned char receiver;
+    unsigned short code;
+    unsigned char frames;
+};
+
+struct serial_ack {
+    unsigned char seq;
+    unsigned char status;
+    unsigned char frames;
+    unsigned int airtime;
+    unsigned short late;
+};
+
+unsigned char serial_crc8(const unsigned char *buffer, unsigned int len);
+void serial_pack_command(const struct serial_command *command,
+        unsigned char *buffer);
+int serial_unpack_command(const unsigned char *buffer,
+        struct serial_command *command);
+void serial_pack_ack(const struct serial_ack *ack, unsigned char *buffer);
+int serial_unpack_ack(const unsigned char *buffer, struct serial_ack *ack);
+
+int serial_open(const char *path);
+int serial_read_ack(int fd, struct serial_ack *ack, int timeout_ms);
+int serial_transmit(int fd, struct serial_command *command,
+        struct serial_ack *ack, int timeout_ms);
+
+#endif
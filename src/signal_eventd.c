@@ -14,100 +14,1253 @@
  * 02110-1301, USA.
  */
 
+#define _GNU_SOURCE
+
 #include <wiringPi.h>
 #include <arpa/inet.h>
 #include <libconfig.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <getopt.h>
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 
 #include "common.h"
-#include "srts.h"
+#include "protocol.h"
+#include "dedupe.h"
+#include "pulse_ring.h"
+#include "trace.h"
+#include "telemetry.h"
+#include "samples.h"
+#include "gpiochip.h"
+#include "edge_stream.h"
+#include "serial.h"
+#include "rt.h"
+#include "registry.h"
+#include "capture.h"
+#include "client.h"
+
+/* number of edges handed to the decoder at once */
+#define DECODER_BATCH 64
+
+#define METRICS_FILE "/var/run/signal_eventd.metrics"
+#define CONTROL_SOCKET "/var/run/signal_eventd.sock"
+
+/* control connections served at once */
+#define MAX_CLIENTS 8
+
+/* epoll tags, clients follow */
+enum LOOP_SOURCE {
+    LOOP_SIGNAL = 0,
+    LOOP_TIMER,
+    LOOP_CONTROL,
+    LOOP_CLIENT
+};
+
+/* wiringPi interrupt handlers take no argument, one trampoline per slot */
+#define MAX_RECEIVERS 4
+
+/* bytes of samples read at once */
+#define SAMPLES_READ 65536
+
+/* bytes of the receive front-end read at once, several blocks */
+#define STREAM_READ 4096
+
+enum SOURCE {
+    /* edges from the pin interrupts */
+    SOURCE_GPIO = 0,
+    /* edges found in a stream of samples, a file or a pipe */
+    SOURCE_SAMPLES,
+    /* edge events of a gpio character device line */
+    SOURCE_GPIOCHIP,
+    /* edge events recorded from a gpio character device line */
+    SOURCE_EVENTS,
+    /* pulses streamed by the receive front-end, a serial line or a file */
+    SOURCE_SERIAL
+};
 
 extern int verbose;
 extern int debug;
 
-int somfy_handler(int type, int duration) {
-    struct srts_payload payload;
+/*
+ * One receiver per input pin: its own ring, decoder state and decoder
+ * thread, so pins never share anything on the receive path.
+ */
+struct receiver {
+    int source;
+    int gpio;
+    int cpu;
+    unsigned int last_change;
+    int isr_tuned;
+
+    /* every source but SOURCE_GPIO, read by their own thread */
+    const char *input;
+    pthread_t reader;
+    struct samples samples;
+    unsigned int line;
+    struct gpiochip_edges chip_edges;
+    struct edge_stream stream;
+    FILE *capture;
+
+    struct pulse_ring ring;
+    struct protocol_dispatch dispatch;
+    struct dedupe dedupe;
+    pthread_t thread;
+    FILE *record;
+    /* every edge kept in a ring file, written by the decoder thread */
+    const char *history_path;
+    struct capture history;
+
+    /* owned by the decoder thread, read by the metrics writer */
+    unsigned long edges;
+    /* bumped each time the decoder holds no device of the registry */
+    unsigned long quiescent;
+    unsigned int timestamp;
+    struct histogram latency;
+};
+
+static struct receiver receivers[MAX_RECEIVERS];
+static int receiver_count = 0;
+
+static struct rt_config rt;
+
+/*
+ * Read by the decoder threads without any lock, a reload swaps the pointer
+ * and frees the previous registry once no decoder can still be using it.
+ */
+static struct registry *registry = NULL;
+
+/* set by the main loop, the decoders flush their events and return */
+static int stopping = 0;
+
+/*
+ * Requests of the control socket, one text line each, answered by one line,
+ * "ok ..." or "error <reason>": status, reload, flush, shutdown.
+ */
+struct control_client {
+    int fd;
+    unsigned int len;
+    char line[CLIENT_LINE_MAX];
+};
+
+static struct control_client clients[MAX_CLIENTS];
+
+/* micro seconds, -1 keeps the window of each protocol */
+static int dedupe_window = -1;
+
+/* the clock of every timestamp of the receive path, whatever the source */
+static unsigned int now_us() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (unsigned int) ts.tv_sec * 1000000U + ts.tv_nsec / 1000;
+}
+
+static void somfy_handler(struct receiver *receiver,
+        struct srts_payload *payload) {
     unsigned short addr;
     unsigned char *ptr;
-    int rtv;
 
-    rtv = srts_receive(type, duration, &payload);
-    if (rtv == 1 && verbose) {
-        printf("Message correctly received\n");
-        if (debug) {
-            printf("key: %d\n", payload.key);
-            printf("checksum: %d\n", payload.checksum);
-            printf("ctrl: %d\n", payload.ctrl);
-            printf("code: %d\n", payload.code);
-            printf("address 1: %d\n", payload.address.byte1);
-            printf("address 2: %d\n", payload.address.byte2);
-            printf("address 3: %d\n", payload.address.byte3);
+    printf("Message correctly received on gpio %d\n", receiver->gpio);
+    if (debug) {
+        printf("key: %d\n", payload->key);
+        printf("checksum: %d\n", payload->checksum);
+        printf("ctrl: %d\n", payload->ctrl);
+        printf("code: %d\n", payload->code);
+        printf("address 1: %d\n", payload->address.byte1);
+        printf("address 2: %d\n", payload->address.byte2);
+        printf("address 3: %d\n", payload->address.byte3);
 
-            ptr = (unsigned char *)&addr;
-            ptr[0] = payload.address.byte1;
-            ptr[1] = payload.address.byte2;
+        ptr = (unsigned char *)&addr;
+        ptr[0] = payload->address.byte1;
+        ptr[1] = payload->address.byte2;
 
-            printf("address: %d\n", addr);
-        }
+        printf("address: %d\n", addr);
+        printf("half bit: %u us\n", srts_decoder_clock(&receiver->dispatch.srts,
+                    payload->address.byte1 | payload->address.byte2 << 8 |
+                    payload->address.byte3 << 16));
+    }
+}
+
+static void homeasy_handler(struct receiver *receiver,
+        struct homeasy_frame *frame) {
+    printf("HomeEasy message correctly received on gpio %d\n", receiver->gpio);
+    if (debug) {
+        printf("address: %u\n", frame->address);
+        printf("group: %d\n", frame->group);
+        printf("command: %d\n", frame->command);
+        printf("receiver: %d\n", frame->receiver);
+    }
+}
+
+static void device_handler(struct receiver *receiver,
+        const struct registry_device *device, struct frame *frame) {
+    const char *command;
+
+    if (frame->protocol == PROTOCOL_SRTS) {
+        command = srts_command_name(frame->srts.ctrl);
+    } else {
+        command = homeasy_command_name(frame->homeasy.command);
+    }
+
+    printf("%s: %s, received on gpio %d\n", device->name, command,
+            receiver->gpio);
+    if (device->action) {
+        printf("action: %s\n", device->action);
     }
-    return rtv;
 }
 
-void handle_interrupt() {
-    static unsigned int last_change = 0;
-    static unsigned int total_duration = 0;
-    unsigned int duration = 0;
-    long time;
+/* one event per command, once all its repeats have been received */
+static void event_handler(struct dedupe_event *event, void *arg) {
+    struct receiver *receiver = (struct receiver *) arg;
+    const struct registry_device *device = NULL;
+    struct registry *devices;
+
+    if (! verbose) {
+        return;
+    }
+
+    devices = __atomic_load_n(&registry, __ATOMIC_ACQUIRE);
+    if (devices) {
+        device = registry_lookup(devices, &event->frame);
+    }
+
+    if (device) {
+        device_handler(receiver, device, &event->frame);
+    } else if (event->frame.protocol == PROTOCOL_SRTS) {
+        somfy_handler(receiver, &event->frame.srts);
+    } else {
+        homeasy_handler(receiver, &event->frame.homeasy);
+    }
+    printf("repeats: %u, first: %u, last: %u\n", event->repeats, event->first,
+            event->last);
+}
+
+/* every protocol of the receiver delivers its frames here */
+static void frame_handler(struct frame *frame, void *arg) {
+    struct receiver *receiver = (struct receiver *) arg;
+
+    /* from the edge ending the frame to its delivery, in micro seconds */
+    histogram_add(&receiver->latency, now_us() - receiver->timestamp);
+
+    dedupe_frame(&receiver->dedupe, frame, receiver->timestamp);
+}
+
+/*
+ * Runs in the wiringPi interrupt thread, so only timestamp the edge and queue
+ * it, anything slower belongs to the decoder thread.
+ */
+static void handle_interrupt(struct receiver *receiver) {
+    unsigned int time;
     int type;
 
-    type = digitalRead (2);
+    /* the thread is wiringPi's, only known once it calls us */
+    if (! receiver->isr_tuned) {
+        rt_apply(&rt, RT_ISR);
+        receiver->isr_tuned = 1;
+    }
+
+    type = digitalRead (receiver->gpio);
     if (type == LOW) {
         type = HIGH;
     } else {
         type = LOW;
     }
 
-    time = micros();
-    if (last_change) {
-        duration = time - last_change;
+    time = now_us();
+    if (receiver->last_change) {
+        pulse_ring_push(&receiver->ring, type, time - receiver->last_change,
+                time);
+    }
+    receiver->last_change = time;
+}
+
+#define RECEIVER_ISR(n) \
+    static void handle_interrupt_##n() { handle_interrupt(&receivers[n]); }
+
+RECEIVER_ISR(0)
+RECEIVER_ISR(1)
+RECEIVER_ISR(2)
+RECEIVER_ISR(3)
+
+static void (*receiver_isrs[MAX_RECEIVERS])() = {
+    handle_interrupt_0, handle_interrupt_1, handle_interrupt_2,
+    handle_interrupt_3
+};
+
+static void *decoder_thread(void *arg) {
+    struct receiver *receiver = (struct receiver *) arg;
+    struct pulse pulses[DECODER_BATCH];
+    struct timespec idle = { 0, 2000000 };
+    struct pulse_filter filter = { 0 };
+    unsigned int count, duration, i;
+    cpu_set_t cpus;
+
+    rt_apply(&rt, RT_DECODER);
+    if (receiver->cpu != -1) {
+        CPU_ZERO(&cpus);
+        CPU_SET(receiver->cpu, &cpus);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0) {
+            fprintf(stderr, "Unable to pin the decoder of gpio %d to cpu %d\n",
+                    receiver->gpio, receiver->cpu);
+        }
+    }
+
+    while (! __atomic_load_n(&stopping, __ATOMIC_ACQUIRE)) {
+        __atomic_store_n(&receiver->quiescent, receiver->quiescent + 1,
+                __ATOMIC_RELEASE);
+
+        dedupe_expire(&receiver->dedupe, now_us());
+
+        count = pulse_ring_pop(&receiver->ring, pulses, DECODER_BATCH);
+        if (count == 0) {
+            nanosleep(&idle, NULL);
+            continue;
+        }
+
+        __atomic_store_n(&receiver->edges, receiver->edges + count,
+                __ATOMIC_RELAXED);
+
+        for (i = 0; i != count; i++) {
+            receiver->timestamp = pulses[i].timestamp;
+            if (receiver->record) {
+                trace_write(receiver->record, pulses[i].type,
+                        pulses[i].duration);
+            }
+            if (receiver->history_path) {
+                capture_edge(&receiver->history, pulses[i].type,
+                        pulses[i].duration, pulses[i].timestamp);
+            }
+            if (pulse_filter(&filter, pulses[i].duration, &duration)) {
+                protocol_feed(&receiver->dispatch, pulses[i].type, duration);
+            }
+        }
+    }
+
+    /* nothing pending is lost on the way out */
+    dedupe_flush(&receiver->dedupe);
+
+    return NULL;
+}
+
+/* the ring is waited on rather than overflowed, a stream can be replayed */
+static void wait_push(struct receiver *receiver, int type,
+        unsigned int duration, unsigned int timestamp) {
+    struct timespec wait = { 0, 1000000 };
+
+    while (pulse_ring_full(&receiver->ring)) {
+        nanosleep(&wait, NULL);
+    }
+    pulse_ring_push(&receiver->ring, type, duration, timestamp);
+}
+
+static void sample_pulse(int type, unsigned int duration, void *arg) {
+    wait_push((struct receiver *) arg, type, duration, now_us());
+}
+
+/* kernel timestamps share the clock of now_us(), recorded ones do not */
+static void event_pulse(int type, unsigned int duration,
+        unsigned int timestamp, void *arg) {
+    struct receiver *receiver = (struct receiver *) arg;
+
+    if (receiver->source == SOURCE_EVENTS) {
+        timestamp = now_us();
+    }
+    wait_push(receiver, type, duration, timestamp);
+}
+
+static void *event_thread(void *arg) {
+    struct receiver *receiver = (struct receiver *) arg;
+    struct gpio_v2_line_event events[GPIOCHIP_BATCH];
+    int fd, count;
+
+    rt_apply(&rt, RT_READER);
+    if (receiver->source == SOURCE_GPIOCHIP) {
+        fd = gpiochip_request(receiver->input, receiver->line, "signal_eventd");
     } else {
-        last_change = time;
+        fd = open(receiver->input, O_RDONLY);
+    }
+    if (fd == -1) {
+        fprintf(stderr, "Unable to open the edge events: %s\n",
+                receiver->input);
+        return NULL;
+    }
+
+    while ((count = gpiochip_read(fd, events)) > 0) {
+        if (receiver->capture) {
+            fwrite(events, sizeof(events[0]), count, receiver->capture);
+        }
+        gpiochip_edges_feed(&receiver->chip_edges, events, count);
+    }
+
+    if (verbose) {
+        fprintf(stderr, "End of the edge events of %s, %lu events, %lu lost\n",
+                receiver->input, receiver->chip_edges.events,
+                receiver->chip_edges.lost);
+    }
+    close(fd);
+
+    return NULL;
+}
+
+/* a whole block at once, all its pulses arrived at the same time */
+static void stream_pulse(int type, unsigned int duration, void *arg) {
+    struct receiver *receiver = (struct receiver *) arg;
+
+    wait_push(receiver, type, duration, receiver->last_change);
+}
+
+/*
+ * The board already merged the glitches and only wakes us up once per block,
+ * read as much as is there, the decoder takes it in batches.
+ */
+static void *serial_thread(void *arg) {
+    struct receiver *receiver = (struct receiver *) arg;
+    unsigned char buffer[STREAM_READ];
+    struct pollfd pfd;
+    ssize_t len;
+    int fd;
+
+    rt_apply(&rt, RT_READER);
+    if ((fd = serial_open(receiver->input)) == -1) {
+        fprintf(stderr, "Unable to open the receive front-end: %s\n",
+                receiver->input);
+        return NULL;
+    }
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    while (poll(&pfd, 1, -1) > 0 &&
+            (len = read(fd, buffer, sizeof(buffer))) > 0) {
+        if (receiver->capture) {
+            fwrite(buffer, 1, len, receiver->capture);
+        }
+        receiver->last_change = now_us();
+        edge_stream_feed(&receiver->stream, buffer, len);
+    }
+
+    if (verbose) {
+        fprintf(stderr, "End of the receive front-end %s, %lu blocks, "
+                "%lu lost, %lu errors\n", receiver->input,
+                receiver->stream.blocks, receiver->stream.lost,
+                receiver->stream.errors);
+    }
+    close(fd);
+
+    return NULL;
+}
+
+static void *sample_thread(void *arg) {
+    struct receiver *receiver = (struct receiver *) arg;
+    unsigned char *buffer;
+    ssize_t len;
+    int fd = 0;
+
+    rt_apply(&rt, RT_READER);
+    if (strcmp(receiver->input, "-") != 0 &&
+            (fd = open(receiver->input, O_RDONLY)) == -1) {
+        fprintf(stderr, "Unable to open the sample stream: %s\n",
+                receiver->input);
+        return NULL;
+    }
+
+    if ((buffer = (unsigned char *) malloc(SAMPLES_READ)) == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        exit(-1);
+    }
+
+    while ((len = read(fd, buffer, SAMPLES_READ)) > 0) {
+        samples_scan(&receiver->samples, buffer, len);
+    }
+    samples_flush(&receiver->samples);
+
+    if (verbose) {
+        fprintf(stderr, "End of the sample stream %s, %lu edges\n",
+                receiver->input, receiver->samples.edges);
+    }
+
+    free(buffer);
+    if (fd != 0) {
+        close(fd);
+    }
+
+    return NULL;
+}
+
+static int start_receiver(struct receiver *receiver, void (*isr)()) {
+    void *(*reader)(void *);
+    struct samples *samples;
+
+    pulse_ring_init(&receiver->ring);
+    protocol_init(&receiver->dispatch, frame_handler, receiver);
+    dedupe_init(&receiver->dedupe, event_handler, receiver);
+    if (dedupe_window != -1) {
+        dedupe_set_window(&receiver->dedupe, dedupe_window);
+    }
+    receiver->last_change = 0;
+    receiver->isr_tuned = 0;
+    receiver->edges = 0;
+    histogram_init(&receiver->latency);
+
+    if (receiver->source == SOURCE_SAMPLES) {
+        samples = &receiver->samples;
+        samples_init(samples, samples->format, samples->rate,
+                samples->threshold, sample_pulse, receiver);
+    } else if (receiver->source == SOURCE_SERIAL) {
+        edge_stream_init(&receiver->stream, stream_pulse, receiver);
+    } else if (receiver->source != SOURCE_GPIO) {
+        gpiochip_edges_init(&receiver->chip_edges, event_pulse, receiver);
+    }
+
+    if (rt_thread_create(&receiver->thread, decoder_thread, receiver) != 0) {
+        fprintf(stderr, "Unable to start the decoder thread for gpio %d\n",
+                receiver->gpio);
+        return -1;
+    }
+
+    if (receiver->source != SOURCE_GPIO) {
+        if (receiver->source == SOURCE_SAMPLES) {
+            reader = sample_thread;
+        } else if (receiver->source == SOURCE_SERIAL) {
+            reader = serial_thread;
+        } else {
+            reader = event_thread;
+        }
+        if (rt_thread_create(&receiver->reader, reader, receiver) != 0) {
+            fprintf(stderr, "Unable to start the reader of %s\n",
+                    receiver->input);
+            return -1;
+        }
+        return 0;
+    }
+
+    pinMode(receiver->gpio, INPUT);
+    wiringPiISR (receiver->gpio, INT_EDGE_BOTH, isr);
+
+    return 0;
+}
+
+/* swap first, free once every decoder has been seen outside of a lookup */
+static int reload_registry(const char *path) {
+    unsigned long seen[MAX_RECEIVERS];
+    struct timespec wait = { 0, 1000000 };
+    struct registry *loaded, *old;
+    int i;
+
+    if ((loaded = registry_load(path)) == NULL) {
+        fprintf(stderr, "Keeping the previous devices\n");
+        return -1;
+    }
+    if (loaded->verbose != -1) {
+        verbose = loaded->verbose;
+    }
+
+    old = __atomic_exchange_n(&registry, loaded, __ATOMIC_ACQ_REL);
+
+    for (i = 0; i != receiver_count; i++) {
+        seen[i] = __atomic_load_n(&receivers[i].quiescent, __ATOMIC_ACQUIRE);
+    }
+    for (i = 0; i != receiver_count; i++) {
+        while (__atomic_load_n(&receivers[i].quiescent, __ATOMIC_ACQUIRE) ==
+                seen[i]) {
+            nanosleep(&wait, NULL);
+        }
+    }
+    registry_free(old);
+
+    fprintf(stderr, "%u devices loaded from %s\n", loaded->count, path);
+
+    return 0;
+}
+
+static void flush_records() {
+    int i;
+
+    for (i = 0; i != receiver_count; i++) {
+        if (receivers[i].record) {
+            fflush(receivers[i].record);
+        }
+        if (receivers[i].capture) {
+            fflush(receivers[i].capture);
+        }
+    }
+}
+
+static void report_ring_stats() {
+    static unsigned int last_overflows[MAX_RECEIVERS];
+    struct pulse_ring *ring;
+    unsigned int overflows;
+    int i;
+
+    for (i = 0; i != receiver_count; i++) {
+        ring = &receivers[i].ring;
+
+        overflows = pulse_ring_overflows(ring);
+        if (overflows != last_overflows[i]) {
+            fprintf(stderr, "Pulse ring overflow on gpio %d: %u edges dropped, "
+                    "high water: %u/%u\n", receivers[i].gpio, overflows,
+                    pulse_ring_high_water(ring), PULSE_RING_SIZE);
+            last_overflows[i] = overflows;
+        }
+    }
+}
+
+static void write_receiver_metrics(FILE *fp, struct receiver *receiver) {
+    struct protocol_dispatch *dispatch = &receiver->dispatch;
+    int gpio = receiver->gpio;
+
+    telemetry_counter(fp, "signal_eventd_edges_total", gpio, NULL,
+            TELEMETRY_READ(receiver->edges));
+    telemetry_counter(fp, "signal_eventd_ring_overflows_total", gpio, NULL,
+            pulse_ring_overflows(&receiver->ring));
+    telemetry_counter(fp, "signal_eventd_ring_high_water", gpio, NULL,
+            pulse_ring_high_water(&receiver->ring));
+    if (receiver->source == SOURCE_GPIOCHIP) {
+        telemetry_counter(fp, "signal_eventd_kernel_events_lost_total", gpio,
+                NULL, TELEMETRY_READ(receiver->chip_edges.lost));
+    } else if (receiver->source == SOURCE_SERIAL) {
+        telemetry_counter(fp, "signal_eventd_serial_blocks_total", gpio, NULL,
+                TELEMETRY_READ(receiver->stream.blocks));
+        telemetry_counter(fp, "signal_eventd_serial_blocks_lost_total", gpio,
+                NULL, TELEMETRY_READ(receiver->stream.lost));
+        telemetry_counter(fp, "signal_eventd_serial_errors_total", gpio, NULL,
+                TELEMETRY_READ(receiver->stream.errors));
+    }
+
+    telemetry_counter(fp, "signal_eventd_syncs_total", gpio, "somfy",
+            TELEMETRY_READ(dispatch->srts.syncs));
+    telemetry_counter(fp, "signal_eventd_bit_errors_total", gpio, "somfy",
+            TELEMETRY_READ(dispatch->srts.sync_losses));
+    telemetry_counter(fp, "signal_eventd_checksum_errors_total", gpio, "somfy",
+            TELEMETRY_READ(dispatch->srts.checksum_errors));
+    telemetry_counter(fp, "signal_eventd_frames_total", gpio, "somfy",
+            TELEMETRY_READ(dispatch->srts.frames));
+
+    telemetry_counter(fp, "signal_eventd_syncs_total", gpio, "homeasy",
+            TELEMETRY_READ(dispatch->homeasy.syncs));
+    telemetry_counter(fp, "signal_eventd_bit_errors_total", gpio, "homeasy",
+            TELEMETRY_READ(dispatch->homeasy.sync_losses));
+    telemetry_counter(fp, "signal_eventd_frames_total", gpio, "homeasy",
+            TELEMETRY_READ(dispatch->homeasy.frames));
+
+    telemetry_counter(fp, "signal_eventd_events_total", gpio, NULL,
+            TELEMETRY_READ(receiver->dedupe.events));
+    telemetry_counter(fp, "signal_eventd_dedupe_evictions_total", gpio, NULL,
+            TELEMETRY_READ(receiver->dedupe.evictions));
+
+    telemetry_histogram(fp, "signal_eventd_frame_latency_us", gpio,
+            &receiver->latency);
+}
+
+/* replaced at once, a scraper never reads a partial file */
+static void write_metrics(const char *path) {
+    char tmp[PATH_MAX];
+    FILE *fp;
+    int i;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    if ((fp = fopen(tmp, "w")) == NULL) {
         return;
     }
-    last_change = time;
+    for (i = 0; i != receiver_count; i++) {
+        write_receiver_metrics(fp, &receivers[i]);
+    }
+    if (fclose(fp) == 0) {
+        rename(tmp, path);
+    }
+}
+
+static int control_socket(const char *path) {
+    struct sockaddr_un addr;
+    int fd;
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                    0)) == -1) {
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    unlink(path);
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1 ||
+            chmod(path, 0660) == -1 || listen(fd, MAX_CLIENTS) == -1) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static int status_line(char *reply, int size) {
+    struct receiver *receiver;
+    int len, i;
+
+    len = snprintf(reply, size, "ok");
+    for (i = 0; i != receiver_count && len < size; i++) {
+        receiver = &receivers[i];
+        len += snprintf(reply + len, size - len,
+                "%s gpio %d: %lu edges, %lu frames, %lu events, %u dropped",
+                i ? ";" : "", receiver->gpio, TELEMETRY_READ(receiver->edges),
+                TELEMETRY_READ(receiver->dispatch.srts.frames) +
+                TELEMETRY_READ(receiver->dispatch.homeasy.frames),
+                TELEMETRY_READ(receiver->dedupe.events),
+                pulse_ring_overflows(&receiver->ring));
+    }
+
+    return len;
+}
+
+/* the answer to a request, returns 1 when the daemon has to stop */
+static int control_request(char *line, char *reply, int size,
+        const char *config, const char *metrics) {
+    if (strcmp(line, "status") == 0) {
+        status_line(reply, size);
+    } else if (strcmp(line, "reload") == 0) {
+        if (config == NULL) {
+            snprintf(reply, size, "error no configuration file");
+        } else if (reload_registry(config) == -1) {
+            snprintf(reply, size, "error invalid configuration file");
+        } else {
+            snprintf(reply, size, "ok %u devices", registry->count);
+        }
+    } else if (strcmp(line, "flush") == 0) {
+        flush_records();
+        write_metrics(metrics);
+        snprintf(reply, size, "ok");
+    } else if (strcmp(line, "shutdown") == 0) {
+        snprintf(reply, size, "ok");
+        return 1;
+    } else {
+        snprintf(reply, size, "error invalid request");
+    }
+
+    return 0;
+}
+
+static void close_client(struct control_client *client) {
+    close(client->fd);
+    client->fd = -1;
+}
+
+/*
+ * Whatever a client sent, every complete line answered. The socket never
+ * blocks the loop, a client too slow to take its answer is dropped.
+ */
+static int control_read(struct control_client *client, const char *config,
+        const char *metrics) {
+    char reply[CLIENT_LINE_MAX], *end;
+    int rtv = 0, len;
+    ssize_t n;
+
+    n = read(client->fd, client->line + client->len,
+            sizeof(client->line) - client->len - 1);
+    if (n <= 0) {
+        if (n == 0 || errno != EAGAIN) {
+            close_client(client);
+        }
+        return 0;
+    }
+    client->len += n;
+    client->line[client->len] = '\0';
 
-    /* simple noise reduction */
-    total_duration += duration;
-    if (duration > 200) {
-        somfy_handler(type, total_duration);
-        total_duration = 0;
+    while ((end = strchr(client->line, '\n')) != NULL) {
+        *end = '\0';
+        if (end != client->line && end[-1] == '\r') {
+            end[-1] = '\0';
+        }
+        rtv |= control_request(client->line, reply, sizeof(reply) - 1,
+                config, metrics);
+
+        len = strlen(reply);
+        reply[len++] = '\n';
+        if (write(client->fd, reply, len) != len) {
+            close_client(client);
+            return rtv;
+        }
+
+        client->len -= end + 1 - client->line;
+        memmove(client->line, end + 1, client->len + 1);
     }
+
+    if (client->len == sizeof(client->line) - 1) {
+        close_client(client);
+    }
+
+    return rtv;
+}
+
+static void control_accept(int epfd, int fd) {
+    struct epoll_event event;
+    int client, i;
+
+    while ((client = accept4(fd, NULL, NULL, SOCK_NONBLOCK |
+                    SOCK_CLOEXEC)) != -1) {
+        for (i = 0; i != MAX_CLIENTS && clients[i].fd != -1; i++);
+        if (i == MAX_CLIENTS) {
+            close(client);
+            continue;
+        }
+
+        clients[i].fd = client;
+        clients[i].len = 0;
+        event.events = EPOLLIN;
+        event.data.u32 = LOOP_CLIENT + i;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, client, &event) == -1) {
+            close_client(&clients[i]);
+        }
+    }
+}
+
+static int loop_add(int epfd, int fd, unsigned int tag) {
+    struct epoll_event event;
+
+    event.events = EPOLLIN;
+    event.data.u32 = tag;
+
+    return epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &event);
+}
+
+/*
+ * The main thread only waits here: signals, the periodic work and the
+ * control socket. The edges never go through it, every source and decoder
+ * has its own thread. Returns once asked to stop.
+ */
+static int event_loop(sigset_t *signals, const char *config,
+        const char *metrics, const char *control) {
+    struct itimerspec period = { { 1, 0 }, { 1, 0 } };
+    struct epoll_event events[MAX_CLIENTS + 3];
+    struct signalfd_siginfo info;
+    int epfd, sigfd, timerfd, ctlfd = -1, stop = 0, n, i;
+    unsigned long long expirations;
+    unsigned int tag;
+
+    for (i = 0; i != MAX_CLIENTS; i++) {
+        clients[i].fd = -1;
+    }
+
+    if ((epfd = epoll_create1(EPOLL_CLOEXEC)) == -1 ||
+            (sigfd = signalfd(-1, signals, SFD_NONBLOCK | SFD_CLOEXEC)) == -1 ||
+            (timerfd = timerfd_create(CLOCK_MONOTONIC,
+                TFD_NONBLOCK | TFD_CLOEXEC)) == -1 ||
+            timerfd_settime(timerfd, 0, &period, NULL) == -1) {
+        perror("event loop");
+        return -1;
+    }
+    if (control && (ctlfd = control_socket(control)) == -1) {
+        fprintf(stderr, "Unable to listen on %s: %s\n", control,
+                strerror(errno));
+        return -1;
+    }
+    if (loop_add(epfd, sigfd, LOOP_SIGNAL) == -1 ||
+            loop_add(epfd, timerfd, LOOP_TIMER) == -1 ||
+            (ctlfd != -1 && loop_add(epfd, ctlfd, LOOP_CONTROL) == -1)) {
+        perror("epoll_ctl");
+        return -1;
+    }
+
+    while (! stop) {
+        if ((n = epoll_wait(epfd, events, MAX_CLIENTS + 3, -1)) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("epoll_wait");
+            break;
+        }
+
+        for (i = 0; i != n; i++) {
+            tag = events[i].data.u32;
+            switch (tag) {
+                case LOOP_SIGNAL:
+                    while (read(sigfd, &info, sizeof(info)) == sizeof(info)) {
+                        if (info.ssi_signo != SIGHUP) {
+                            stop = 1;
+                        } else if (config) {
+                            reload_registry(config);
+                        }
+                    }
+                    break;
+                case LOOP_TIMER:
+                    if (read(timerfd, &expirations, sizeof(expirations)) !=
+                            sizeof(expirations)) {
+                        break;
+                    }
+                    flush_records();
+                    write_metrics(metrics);
+                    if (verbose) {
+                        report_ring_stats();
+                    }
+                    break;
+                case LOOP_CONTROL:
+                    control_accept(epfd, ctlfd);
+                    break;
+                default:
+                    if (clients[tag - LOOP_CLIENT].fd != -1) {
+                        stop |= control_read(&clients[tag - LOOP_CLIENT],
+                                config, metrics);
+                    }
+            }
+        }
+    }
+
+    for (i = 0; i != MAX_CLIENTS; i++) {
+        if (clients[i].fd != -1) {
+            close_client(&clients[i]);
+        }
+    }
+    if (ctlfd != -1) {
+        close(ctlfd);
+        unlink(control);
+    }
+    close(timerfd);
+    close(sigfd);
+    close(epfd);
+
+    return 0;
+}
+
+/* the decoders flush what they hold, then every file is left complete */
+static void shutdown_receivers(const char *metrics) {
+    int i;
+
+    __atomic_store_n(&stopping, 1, __ATOMIC_RELEASE);
+    for (i = 0; i != receiver_count; i++) {
+        pthread_join(receivers[i].thread, NULL);
+    }
+
+    flush_records();
+    for (i = 0; i != receiver_count; i++) {
+        if (receivers[i].record) {
+            fclose(receivers[i].record);
+        }
+        if (receivers[i].capture) {
+            fclose(receivers[i].capture);
+        }
+        if (receivers[i].history_path) {
+            capture_close(&receivers[i].history);
+        }
+    }
+    write_metrics(metrics);
+    fflush(stdout);
+}
+
+static void usage(char *name) {
+    printf(
+        "Usage: %s [(--gpio <gpio pin> | --samples <file> --rate <samples/s> "
+        "[--sample-format u8|bit] [--threshold <level>] | "
+        "--gpiochip <chip>:<line> [--record-events <file>] | --events <file> | "
+        "--serial <device> [--record-events <file>]) "
+        "[--cpu <decoder cpu>] [--record <trace file>] [--capture <ring file>]]... "
+        "[--capture-size <MB>] [--metrics <file>] "
+        "[--dedupe-window <ms>] [--rt <spec>]... [--latency-test <seconds>] "
+        "[--config <file>] [--control <socket>]\n",
+        name);
+    rt_usage(stdout);
+    exit(-1);
+}
+
+static struct receiver *add_receiver(int source, int gpio) {
+    struct receiver *receiver;
+
+    if (receiver_count == MAX_RECEIVERS) {
+        return NULL;
+    }
+    receiver = &receivers[receiver_count++];
+    receiver->source = source;
+    receiver->gpio = gpio;
+    receiver->cpu = -1;
+    receiver->record = NULL;
+    receiver->history_path = NULL;
+
+    return receiver;
+}
+
+/* the options of a sample stream apply to the last receiver added */
+static struct samples *last_samples() {
+    if (receiver_count == 0 ||
+            receivers[receiver_count - 1].source != SOURCE_SAMPLES) {
+        return NULL;
+    }
+
+    return &receivers[receiver_count - 1].samples;
 }
 
 int main(int argc, char **argv) {
-    int gpio = 2;
+    struct option long_options[] = { { "gpio", 1, 0, 0 },
+        { "cpu", 1, 0, 0 }, { "record", 1, 0, 0 },
+        { "metrics", 1, 0, 0 }, { "dedupe-window", 1, 0, 0 },
+        { "samples", 1, 0, 0 }, { "rate", 1, 0, 0 },
+        { "sample-format", 1, 0, 0 }, { "threshold", 1, 0, 0 },
+        { "gpiochip", 1, 0, 0 }, { "events", 1, 0, 0 },
+        { "record-events", 1, 0, 0 }, { "serial", 1, 0, 0 },
+        { "rt", 1, 0, 0 }, { "latency-test", 1, 0, 0 },
+        { "config", 1, 0, 0 }, { "capture", 1, 0, 0 },
+        { "capture-size", 1, 0, 0 }, { "control", 1, 0, 0 },
+        { NULL, 0, 0, 0 } };
+    const char *metrics = METRICS_FILE, *config = NULL;
+    const char *control = CONTROL_SOCKET;
+    struct receiver *receiver;
+    struct samples *samples;
+    long int a2i, latency_test = 0, capture_size = CAPTURE_DEFAULT_SIZE;
+    int ncpus, gpios = 0, i, c;
+    char *end, *line;
+    sigset_t signals;
 
     if (setuid(0)) {
         perror("setuid");
         return -1;
     }
 
-    if (wiringPiSetup() == -1) {
+    rt_init(&rt);
+
+    while (1) {
+        c = getopt_long(argc, argv, "", long_options, &i);
+        if (c == -1)
+            break;
+        switch (c) {
+            case 0:
+                if (strcmp(long_options[i].name, "gpio") == 0) {
+                    a2i = strtol(optarg, &end, 10);
+                    if (errno == ERANGE && (a2i == LONG_MAX || a2i == LONG_MIN)) {
+                        break;
+                    }
+                    if (add_receiver(SOURCE_GPIO, a2i) == NULL) {
+                        usage(argv[0]);
+                    }
+                } else if (strcmp(long_options[i].name, "samples") == 0) {
+                    if ((receiver = add_receiver(SOURCE_SAMPLES, -1)) == NULL) {
+                        usage(argv[0]);
+                    }
+                    receiver->input = optarg;
+                    receiver->samples.format = SAMPLES_U8;
+                    receiver->samples.threshold = 128;
+                } else if (strcmp(long_options[i].name, "gpiochip") == 0) {
+                    if ((line = strrchr(optarg, ':')) == NULL ||
+                            (receiver = add_receiver(SOURCE_GPIOCHIP, -1)) == NULL) {
+                        usage(argv[0]);
+                    }
+                    *line++ = '\0';
+                    a2i = strtol(line, &end, 10);
+                    if (*end != '\0' || end == line || a2i < 0) {
+                        usage(argv[0]);
+                    }
+                    receiver->input = optarg;
+                    receiver->line = a2i;
+                    receiver->gpio = a2i;
+                } else if (strcmp(long_options[i].name, "events") == 0) {
+                    if ((receiver = add_receiver(SOURCE_EVENTS, -1)) == NULL) {
+                        usage(argv[0]);
+                    }
+                    receiver->input = optarg;
+                } else if (strcmp(long_options[i].name, "serial") == 0) {
+                    if ((receiver = add_receiver(SOURCE_SERIAL, -1)) == NULL) {
+                        usage(argv[0]);
+                    }
+                    receiver->input = optarg;
+                } else if (strcmp(long_options[i].name, "record-events") == 0) {
+                    if (receiver_count == 0 || (receivers[receiver_count - 1].source !=
+                            SOURCE_GPIOCHIP && receivers[receiver_count - 1].source !=
+                            SOURCE_SERIAL)) {
+                        usage(argv[0]);
+                    }
+                    receiver = &receivers[receiver_count - 1];
+                    if ((receiver->capture = fopen(optarg, "w")) == NULL) {
+                        fprintf(stderr, "Unable to create the event file: %s\n",
+                                optarg);
+                        return -1;
+                    }
+                } else if (strcmp(long_options[i].name, "rate") == 0) {
+                    a2i = strtol(optarg, &end, 10);
+                    if (errno == ERANGE && (a2i == LONG_MAX || a2i == LONG_MIN)) {
+                        break;
+                    }
+                    if ((samples = last_samples()) == NULL || a2i <= 0) {
+                        usage(argv[0]);
+                    }
+                    samples->rate = a2i;
+                } else if (strcmp(long_options[i].name, "sample-format") == 0) {
+                    if ((samples = last_samples()) == NULL ||
+                            (samples->format = samples_format(optarg)) ==
+                            SAMPLES_UNKNOWN) {
+                        usage(argv[0]);
+                    }
+                } else if (strcmp(long_options[i].name, "threshold") == 0) {
+                    a2i = strtol(optarg, &end, 10);
+                    if (errno == ERANGE && (a2i == LONG_MAX || a2i == LONG_MIN)) {
+                        break;
+                    }
+                    if ((samples = last_samples()) == NULL || a2i < 1 ||
+                            a2i > 255) {
+                        usage(argv[0]);
+                    }
+                    samples->threshold = a2i;
+                } else if (strcmp(long_options[i].name, "cpu") == 0) {
+                    a2i = strtol(optarg, &end, 10);
+                    if (errno == ERANGE && (a2i == LONG_MAX || a2i == LONG_MIN)) {
+                        break;
+                    }
+                    if (receiver_count == 0) {
+                        usage(argv[0]);
+                    }
+                    receivers[receiver_count - 1].cpu = a2i;
+                } else if (strcmp(long_options[i].name, "metrics") == 0) {
+                    metrics = optarg;
+                } else if (strcmp(long_options[i].name, "dedupe-window") == 0) {
+                    a2i = strtol(optarg, &end, 10);
+                    if (errno == ERANGE && (a2i == LONG_MAX || a2i == LONG_MIN)) {
+                        break;
+                    }
+                    if (a2i < 0) {
+                        usage(argv[0]);
+                    }
+                    dedupe_window = a2i * 1000;
+                } else if (strcmp(long_options[i].name, "capture") == 0) {
+                    if (receiver_count == 0) {
+                        usage(argv[0]);
+                    }
+                    receivers[receiver_count - 1].history_path = optarg;
+                } else if (strcmp(long_options[i].name, "capture-size") == 0) {
+                    a2i = strtol(optarg, &end, 10);
+                    if (errno == ERANGE && (a2i == LONG_MAX || a2i == LONG_MIN)) {
+                        break;
+                    }
+                    if (a2i <= 0 || a2i > CAPTURE_MAX_SIZE) {
+                        usage(argv[0]);
+                    }
+                    capture_size = a2i;
+                } else if (strcmp(long_options[i].name, "config") == 0) {
+                    config = optarg;
+                } else if (strcmp(long_options[i].name, "control") == 0) {
+                    control = optarg;
+                } else if (strcmp(long_options[i].name, "rt") == 0) {
+                    if (rt_parse(&rt, optarg) == -1) {
+                        usage(argv[0]);
+                    }
+                } else if (strcmp(long_options[i].name, "latency-test") == 0) {
+                    a2i = strtol(optarg, &end, 10);
+                    if (errno == ERANGE && (a2i == LONG_MAX || a2i == LONG_MIN)) {
+                        break;
+                    }
+                    if (a2i <= 0) {
+                        usage(argv[0]);
+                    }
+                    latency_test = a2i;
+                } else if (strcmp(long_options[i].name, "record") == 0) {
+                    if (receiver_count == 0) {
+                        usage(argv[0]);
+                    }
+                    receivers[receiver_count - 1].record = trace_create(optarg);
+                    if (receivers[receiver_count - 1].record == NULL) {
+                        fprintf(stderr, "Unable to create the trace file: %s\n",
+                                optarg);
+                        return -1;
+                    }
+                }
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    /* the decoders are the ones waking up to a deadline */
+    if (latency_test) {
+        rt_lock_memory(&rt);
+        return rt_latency_test(&rt, RT_DECODER, latency_test, stdout) == -1 ?
+            -1 : 0;
+    }
+
+    /* the default file is optional, a file asked for is not */
+    if (config == NULL && access(REGISTRY_FILE, F_OK) == 0) {
+        config = REGISTRY_FILE;
+    }
+    if (config && (registry = registry_load(config)) == NULL) {
+        return -1;
+    }
+
+    if (receiver_count == 0) {
+        add_receiver(SOURCE_GPIO, registry && registry->gpio != -1 ?
+                registry->gpio : 2);
+    }
+
+    for (i = 0; i != receiver_count; i++) {
+        receiver = &receivers[i];
+        if (receiver->source == SOURCE_GPIO) {
+            gpios++;
+        } else if (receiver->source == SOURCE_SAMPLES &&
+                receiver->samples.rate == 0) {
+            usage(argv[0]);
+        }
+    }
+
+    /* spread several decoders over the cores, leaving the first one alone */
+    ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (receiver_count > 1 && ncpus > 1) {
+        for (i = 0; i != receiver_count; i++) {
+            if (receivers[i].cpu == -1) {
+                receivers[i].cpu = 1 + i % (ncpus - 1);
+            }
+        }
+    }
+
+    /* sample streams can be decoded on any box */
+    if (gpios && wiringPiSetup() == -1) {
         fprintf(stderr, "Wiring Pi not installed");
         return -1;
     }
 
-    verbose = 1;
+    verbose = registry && registry->verbose != -1 ? registry->verbose : 1;
+
+    /* blocked before any thread starts, only the loop ever sees them */
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGHUP);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    rt_lock_memory(&rt);
 
-    piHiPri (99);
-    pinMode(gpio, INPUT);
-    wiringPiISR (gpio, INT_EDGE_BOTH, handle_interrupt);
+    /* the capture rings are far too large to be kept in memory */
+    rt_suspend_lock(&rt);
+    for (i = 0; i != receiver_count; i++) {
+        receiver = &receivers[i];
+        if (receiver->history_path && capture_open(&receiver->history,
+                    receiver->history_path, capture_size) == -1) {
+            fprintf(stderr, "Unable to open the capture file: %s\n",
+                    receiver->history_path);
+            return -1;
+        }
+    }
+    rt_resume_lock(&rt);
 
-    while(1) {
-        sleep(1);
+    rt_apply(&rt, RT_MAIN);
+    for (i = 0; i != receiver_count; i++) {
+        if (start_receiver(&receivers[i], receiver_isrs[i]) == -1) {
+            return -1;
+        }
+    }
+
+    if (event_loop(&signals, config, metrics, control) == -1) {
+        return -1;
     }
+    shutdown_receivers(metrics);
 
     return 0;
 }
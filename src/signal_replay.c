@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2014 Sylvain Afchain
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+
+#include "protocol.h"
+#include "dedupe.h"
+#include "trace.h"
+
+extern int verbose;
+
+static void usage(char *name) {
+    printf("Usage: %s [--loops <count>] [--no-calibrate] [--verbose] <trace file>\n", name);
+    exit(-1);
+}
+
+/* position in the trace, in micro seconds, stands for the receive time */
+static unsigned int now = 0;
+
+static void count_event(struct dedupe_event *event, void *arg) {
+    unsigned long *repeats = (unsigned long *) arg;
+
+    *repeats += event->repeats;
+}
+
+static void count_frame(struct frame *frame, void *arg) {
+    dedupe_frame((struct dedupe *) arg, frame, now);
+}
+
+static double elapsed_ns(struct timespec *start, struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+int main(int argc, char **argv) {
+    struct option long_options[] = { { "loops", 1, 0, 0 },
+        { "no-calibrate", 0, 0, 0 }, { "verbose", 0, 0, 0 }, { NULL, 0, 0, 0 } };
+    struct protocol_dispatch dispatch;
+    struct dedupe dedupe;
+    struct pulse_filter filter;
+    struct timespec start, end;
+    struct pulse *pulses;
+    unsigned int count, duration, e;
+    unsigned long edges, repeats = 0;
+    long int a2i;
+    int loops = 1, calibrate = 1, l, i, c;
+    double ns;
+    char *end_ptr;
+
+    while (1) {
+        c = getopt_long(argc, argv, "", long_options, &i);
+        if (c == -1)
+            break;
+        switch (c) {
+            case 0:
+                if (strcmp(long_options[i].name, "loops") == 0) {
+                    a2i = strtol(optarg, &end_ptr, 10);
+                    if (errno == ERANGE && (a2i == LONG_MAX || a2i == LONG_MIN)) {
+                        break;
+                    }
+                    loops = a2i;
+                } else if (strcmp(long_options[i].name, "no-calibrate") == 0) {
+                    calibrate = 0;
+                } else if (strcmp(long_options[i].name, "verbose") == 0) {
+                    verbose = 1;
+                }
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    if (optind != argc - 1 || loops <= 0) {
+        usage(argv[0]);
+    }
+
+    if ((pulses = trace_load(argv[optind], &count)) == NULL) {
+        return -1;
+    }
+
+    protocol_init(&dispatch, count_frame, &dedupe);
+    dedupe_init(&dedupe, count_event, &repeats);
+    dispatch.srts.ook.calibrate = calibrate;
+    memset(&filter, 0, sizeof(filter));
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (l = 0; l != loops; l++) {
+        for (e = 0; e != count; e++) {
+            now += pulses[e].duration;
+            if (pulse_filter(&filter, pulses[e].duration, &duration)) {
+                protocol_feed(&dispatch, pulses[e].type, duration);
+            }
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    dedupe_flush(&dedupe);
+
+    edges = (unsigned long) count * loops;
+    ns = elapsed_ns(&start, &end);
+
+    printf("edges: %lu\n", edges);
+    printf("elapsed: %.3f ms\n", ns / 1e6);
+    if (edges) {
+        printf("edges/sec: %.0f\n", edges / (ns / 1e9));
+        printf("ns/edge: %.2f\n", ns / edges);
+    }
+    printf("somfy syncs: %lu\n", dispatch.srts.syncs);
+    printf("somfy frames decoded: %lu\n", dispatch.srts.frames);
+    printf("somfy checksum failures: %lu\n", dispatch.srts.checksum_errors);
+    printf("somfy sync losses: %lu\n", dispatch.srts.sync_losses);
+    printf("homeasy syncs: %lu\n", dispatch.homeasy.syncs);
+    printf("homeasy frames decoded: %lu\n", dispatch.homeasy.frames);
+    printf("homeasy sync losses: %lu\n", dispatch.homeasy.sync_losses);
+    printf("events: %lu, repeats: %lu\n", dedupe.events, repeats);
+
+    free(pulses);
+
+    return 0;
+}
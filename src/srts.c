@@ -14,12 +14,15 @@
  * 02110-1301, USA.
  */
 
-#include <wiringPi.h>
 #include <stdio.h>
 #include <arpa/inet.h>
 #include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <errno.h>
 
 #include "srts.h"
+#include "ook_protocols.h"
 
 extern int verbose;
 
@@ -44,73 +47,18 @@ static void checksum_payload(struct srts_payload *payload) {
     payload->checksum = checksum;
 }
 
-static void write_bit(int gpio, char bit) {
-    if (bit) {
-        digitalWrite(gpio, LOW);
-        delayMicroseconds(660);
-        digitalWrite(gpio, HIGH);
-        delayMicroseconds(660);
-    } else {
-        digitalWrite(gpio, HIGH);
-        delayMicroseconds(660);
-        digitalWrite(gpio, LOW);
-        delayMicroseconds(660);
-    }
-}
-
-static void write_byte(int gpio, unsigned char byte) {
-    unsigned int mask;
-
-    for (mask = 0b10000000; mask != 0x0; mask >>= 1) {
-        write_bit(gpio, byte & mask);
-    }
-}
-
-static void write_payload(int gpio, struct srts_payload *payload) {
-    unsigned char *p = (unsigned char *) payload;
-    int i;
-
-    for (i = 0; i < 7; i++) {
-        write_byte(gpio, p[i]);
-    }
-}
-
-static void write_interval_gap(int gpio) {
-    digitalWrite(gpio, LOW);
-    delayMicroseconds(30400);
-}
-
-static void sync_transmit(int gpio, int repeated) {
-    int count, i;
-
-    if (repeated) {
-        count = 7;
-    } else {
-        digitalWrite(gpio, HIGH);
-        delayMicroseconds(12400);
-        digitalWrite(gpio, LOW);
-        delayMicroseconds(80600);
-        count = 2;
-    }
-    for (i = 0; i != count; i++) {
-        digitalWrite(gpio, HIGH);
-        delayMicroseconds(2560);
-        digitalWrite(gpio, LOW);
-        delayMicroseconds(2560);
-    }
+/* checksum then obfuscate a payload, in place, ready to be sent */
+void srts_encode(struct srts_payload *payload) {
+    checksum_payload(payload);
+    obfuscate_payload(payload);
 }
 
-void srts_transmit(int gpio, unsigned char key, unsigned short address,
-        unsigned char command, unsigned short code, int repeated) {
+/* append one frame to the timeline, the first of a train is not repeated */
+void srts_compile(struct timeline *timeline, unsigned char key,
+        unsigned short address, unsigned char command, unsigned short code,
+        int repeated) {
     struct srts_payload payload;
 
-    sync_transmit(gpio, repeated);
-
-    digitalWrite(gpio, HIGH);
-    delayMicroseconds(4800);
-    digitalWrite(gpio, LOW);
-    delayMicroseconds(660);
-
     payload.key = key;
     payload.ctrl = command;
     payload.checksum = 0;
@@ -119,176 +67,90 @@ void srts_transmit(int gpio, unsigned char key, unsigned short address,
     payload.address.byte2 = ((char *) &address)[1];
     payload.address.byte3 = 0;
 
-    checksum_payload(&payload);
-    obfuscate_payload(&payload);
-
-    write_payload(gpio, &payload);
-    write_interval_gap(gpio);
-}
-
-static void unfuscate_payload(char *bytes, struct srts_payload *payload) {
-    unsigned char *p;
-    int i = 0;
-
-    p = (unsigned char *) payload;
-
-    p[0] = bytes[0];
-    for (i = 1; i < 7; i++) {
-        p[i] = bytes[i] ^ bytes[i - 1];
-    }
-}
-
-static int validate_checksum(struct srts_payload *payload) {
-    unsigned char *p = (unsigned char *) payload;
-    unsigned char payload_chk = payload->checksum;
-    unsigned char checksum = 0;
-    int i = 0;
-
-    payload->checksum = 0;
-    for (i = 0; i < 7; i++) {
-        checksum = checksum ^ p[i] ^ (p[i] >> 4);
-    }
-    checksum = checksum & 0xf;
-
-    payload->checksum = payload_chk;
-    if (payload_chk == checksum) {
-        return 1;
-    }
+    srts_encode(&payload);
 
-    return 0;
+    ook_compile(timeline, &srts_ook, (unsigned char *) &payload, repeated);
 }
 
-static int is_on_time(int duration, int expected) {
-    int v = expected * 10 / 100;
-
-    return duration > (expected - v) && duration < (expected + v);
+/* frames of a command, the first one then its repeats */
+unsigned int srts_command_frames(unsigned char command) {
+    return command == PROG ? 21 : srts_ook.frames;
 }
 
-static int detect_sync(int type, int *duration) {
-    static unsigned int init_sync = 0;
-    static unsigned int hard_sync = 0;
-    static unsigned int soft_sync = 0;
-
-    if (type && is_on_time(*duration, 12400)) {
-        init_sync = 1;
-    } else if (! type && init_sync == 1 && is_on_time(*duration, 80600)) {
-        init_sync = 2;
-        hard_sync = 10;
-    } else if (init_sync == 2 && hard_sync != 14 && is_on_time(*duration, 2560)) {
-        hard_sync++;
-    } else if (hard_sync == 14 && soft_sync == 0 && is_on_time(*duration, 4800)) {
-        soft_sync = 1;
-    } else if (soft_sync == 1 && *duration > 660) {
-        *duration -= 800;
-        soft_sync = 2;
+/*
+ * A single wakeup for the whole group, then the whole train of every target
+ * in turn. The repeats of a target stay back to back, a receiver sees them
+ * as one command. Returns the number of frames compiled.
+ */
+unsigned int srts_compile_group(struct timeline *timeline,
+        struct srts_target *targets, unsigned int count) {
+    unsigned int frames = 0, train, i, j;
 
-        /* full sync, hard and soft */
-        if (verbose) {
-            fprintf(stderr, "Found the sync part of a message\n");
+    for (i = 0; i != count; i++) {
+        train = srts_command_frames(targets[i].command);
+        for (j = 0; j != train; j++) {
+            srts_compile(timeline, targets[i].key, targets[i].address,
+                    targets[i].command, targets[i].code, frames != 0);
+            frames++;
         }
-        return 1;
-    } else {
-        hard_sync = 0;
-        soft_sync = 0;
     }
 
-    return 0;
+    return frames;
 }
 
-static int read_bit(int type, int *duration, char *bit, int last) {
-    static unsigned int pass = 0;
-
-    /* maximum transmit length for a bit is around 1600 */
-    if (! last && *duration > 2000) {
-        pass = 0;
-
-        return -1;
-    }
-
-    /* duration to low to be a part of only one bit, so split into two parts */
-    if (*duration > 1100) {
-        *duration /= 2;
-    } else {
-        *duration = 0;
-    }
-
-    /* got the two part of a bit */
-    if (pass) {
-        *bit = type;
-        pass = 0;
+const char *srts_command_name(unsigned char command) {
+    static const char *names[] = { "unknown", "my", "up", "my_up", "down",
+        "my_down", "up_down", "unknown", "prog", "sun_flag", "flag" };
 
-        return 1;
+    if (command >= sizeof(names) / sizeof(names[0])) {
+        return "unknown";
     }
-    pass++;
 
-    return 0;
+    return names[command];
 }
 
-static int read_byte(char bit, char *byte) {
-    static char b = 0;
-    static char d = 7;
-
-    if (d != 0) {
-        b |= bit << d--;
-
-        return 0;
-    }
-    *byte = b | bit;
-
-    b = 0;
-    d = 7;
-
-    return 1;
+char srts_command(const char *command) {
+    if (strcasecmp(command, "my") == 0) {
+        return MY;
+    } else if (strcasecmp(command, "up") == 0) {
+        return UP;
+    } else if (strcasecmp(command, "my_up") == 0) {
+        return MY_UP;
+    } else if (strcasecmp(command, "down") == 0) {
+        return DOWN;
+    } else if (strcasecmp(command, "my_down") == 0) {
+        return MY_DOWN;
+    } else if (strcasecmp(command, "up_down") == 0) {
+        return UP_DOWN;
+    } else if (strcasecmp(command, "prog") == 0) {
+        return PROG;
+    } else if (strcasecmp(command, "sun_flag") == 0) {
+        return SUN_FLAG;
+    } else if (strcasecmp(command, "flag") == 0) {
+        return FLAG;
+    }
+
+    return UNKNOWN;
 }
 
-int srts_receive(int type, int duration, struct srts_payload *payload) {
-    static unsigned int sync = 0;
-    static unsigned int index = 0;
-    static char bytes[7];
-    char bit;
-    int rtv;
-
-    if (!sync) {
-        sync = detect_sync(type, &duration);
-        if (! sync) {
-            return -1;
-        }
-        memset(bytes, 0, 7);
+/* parse a <address>:<command> target, the code and key are left untouched */
+int srts_target(char *spec, struct srts_target *target) {
+    char *command, *end;
+    long int a2i;
 
-        /* to short, ignore trailling signal */
-        if (duration < 400) {
-            return 0;
-        }
+    if ((command = strchr(spec, ':')) == NULL) {
+        return -1;
     }
 
-    while(duration > 0) {
-        rtv = read_bit(type, &duration, &bit, index == 6);
-        if (rtv == -1) {
-            if (verbose) {
-                fprintf(stderr, "Error while reading a bit\n");
-            }
-            sync = 0;
-            index = 0;
-
-            return -1;
-        }
-        if (rtv == 1) {
-            rtv = read_byte(bit, bytes + index);
-            if (rtv) {
-                if (++index == 7) {
-                    sync = 0;
-                    index = 0;
-
-                    unfuscate_payload(bytes, payload);
-                    rtv = validate_checksum(payload);
-                    if (rtv == 0 && verbose) {
-                        fprintf(stderr, "Checksum error\n");
-                    }
+    errno = 0;
+    a2i = strtol(spec, &end, 10);
+    if (errno != 0 || end != command || a2i <= 0 || a2i > 0xffff) {
+        return -1;
+    }
+    target->address = a2i;
 
-                    return rtv;
-                }
-            }
-        }
+    if ((target->command = srts_command(command + 1)) == UNKNOWN) {
+        return -1;
     }
 
     return 0;
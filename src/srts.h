@@ -17,6 +17,9 @@
 #ifndef __SRTS_H__
 #define __SRTS_H__
 
+#include "timeline.h"
+#include "ook.h"
+
 enum COMMAND {
     UNKNOWN = 0,
     MY = 1,
@@ -42,8 +45,70 @@ struct srts_payload {
     } address;
 };
 
-void srts_transmit(int gpio, unsigned char key, unsigned short address,
-        unsigned char command, unsigned short code, int repeated);
+/* nominal durations in micro seconds */
+#define SRTS_HALF_BIT 660
+#define SRTS_HARD_SYNC 2560
+#define SRTS_SOFT_SYNC 4800
+
+/* per address clock estimates kept by a decoder, direct mapped */
+#define SRTS_CLOCKS 64
+
+struct srts_clock {
+    unsigned int address;
+    unsigned int half;
+};
+
+/*
+ * Receive state for one pulse stream, every stream decoded in parallel needs
+ * its own decoder.
+ */
+struct srts_decoder {
+    struct ook_decoder ook;
+
+    /*
+     * Half bit duration learned from the sync of the current frame, fixed to
+     * SRTS_HALF_BIT when ook.calibrate is not set.
+     */
+    unsigned int half;
+    struct srts_clock clocks[SRTS_CLOCKS];
+
+    /* statistics, never reset by srts_decoder_reset */
+    unsigned long syncs;
+    unsigned long sync_losses;
+    unsigned long checksum_errors;
+    unsigned long frames;
+};
+
+/* most targets sent in one group transmission */
+#define SRTS_GROUP_MAX 64
+
+/* one remote of a group transmission */
+struct srts_target {
+    unsigned short address;
+    unsigned char command;
+    unsigned char key;
+    unsigned short code;
+};
+
+void srts_compile(struct timeline *timeline, unsigned char key,
+        unsigned short address, unsigned char command, unsigned short code,
+        int repeated);
+unsigned int srts_command_frames(unsigned char command);
+unsigned int srts_compile_group(struct timeline *timeline,
+        struct srts_target *targets, unsigned int count);
+char srts_command(const char *command);
+const char *srts_command_name(unsigned char command);
+int srts_target(char *spec, struct srts_target *target);
+void srts_encode(struct srts_payload *payload);
+int srts_decode(char *bytes, struct srts_payload *payload);
+
 int srts_receive(int type, int duration, struct srts_payload *payload);
 
+void srts_decoder_init(struct srts_decoder *decoder);
+void srts_decoder_reset(struct srts_decoder *decoder);
+int srts_decoder_feed(struct srts_decoder *decoder, int type, int duration,
+        struct srts_payload *payload);
+unsigned int srts_decoder_clock(struct srts_decoder *decoder,
+        unsigned int address);
+
 #endif
@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2014 Sylvain Afchain
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "srts_batch.h"
+
+typedef unsigned char lanes_t __attribute__((vector_size(SRTS_BATCH_LANES)));
+
+static inline lanes_t load(unsigned char *plane, unsigned int n) {
+    return *(lanes_t *) (plane + n);
+}
+
+static inline void store(unsigned char *plane, unsigned int n, lanes_t v) {
+    *(lanes_t *) (plane + n) = v;
+}
+
+/* same nibble checksum as checksum_payload, with its own nibble at zero */
+static inline lanes_t checksum(lanes_t b[7]) {
+    lanes_t sum = b[0] ^ (b[0] >> 4);
+    int i;
+
+    for (i = 1; i < 7; i++) {
+        sum ^= b[i] ^ (b[i] >> 4);
+    }
+
+    return sum & 0xf;
+}
+
+int srts_batch_init(struct srts_batch *batch, unsigned int count) {
+    int i;
+
+    memset(batch, 0, sizeof(struct srts_batch));
+    batch->count = count;
+    batch->size = (count + SRTS_BATCH_LANES - 1) & ~(SRTS_BATCH_LANES - 1);
+
+    for (i = 0; i < 7; i++) {
+        if (posix_memalign((void **) &batch->bytes[i], SRTS_BATCH_LANES,
+                batch->size + SRTS_BATCH_LANES) != 0) {
+            srts_batch_free(batch);
+            return -1;
+        }
+        memset(batch->bytes[i], 0, batch->size + SRTS_BATCH_LANES);
+    }
+
+    return 0;
+}
+
+void srts_batch_free(struct srts_batch *batch) {
+    int i;
+
+    for (i = 0; i < 7; i++) {
+        free(batch->bytes[i]);
+        batch->bytes[i] = NULL;
+    }
+}
+
+void srts_batch_set(struct srts_batch *batch, unsigned int n,
+        struct srts_payload *payload) {
+    unsigned char *p = (unsigned char *) payload;
+    int i;
+
+    for (i = 0; i < 7; i++) {
+        batch->bytes[i][n] = p[i];
+    }
+}
+
+void srts_batch_get(struct srts_batch *batch, unsigned int n,
+        struct srts_payload *payload) {
+    unsigned char *p = (unsigned char *) payload;
+    int i;
+
+    for (i = 0; i < 7; i++) {
+        p[i] = batch->bytes[i][n];
+    }
+}
+
+/* checksum then obfuscate every frame in place, as srts_encode does */
+void srts_batch_encode(struct srts_batch *batch) {
+    unsigned int n;
+    lanes_t b[7];
+    int i;
+
+    for (n = 0; n < batch->size; n += SRTS_BATCH_LANES) {
+        for (i = 0; i < 7; i++) {
+            b[i] = load(batch->bytes[i], n);
+        }
+
+        /* the checksum is the low nibble of the second byte */
+        b[1] &= 0xf0;
+        b[1] |= checksum(b);
+
+        store(batch->bytes[0], n, b[0]);
+        for (i = 1; i < 7; i++) {
+            b[i] ^= b[i - 1];
+            store(batch->bytes[i], n, b[i]);
+        }
+    }
+}
+
+/*
+ * Unfuscate every frame in place and check its checksum, as srts_decode
+ * does. valid, if not NULL, gets 1 or 0 per frame. Returns the number of
+ * valid frames.
+ */
+unsigned int srts_batch_validate(struct srts_batch *batch,
+        unsigned char *valid) {
+    unsigned char flags[SRTS_BATCH_LANES];
+    unsigned int n, total = 0, j, lanes;
+    lanes_t b[7], prev, sent, ok;
+    int i;
+
+    for (n = 0; n < batch->size; n += SRTS_BATCH_LANES) {
+        prev = load(batch->bytes[0], n);
+        b[0] = prev;
+        for (i = 1; i < 7; i++) {
+            b[i] = load(batch->bytes[i], n);
+            b[i] ^= prev;
+            prev ^= b[i];
+            store(batch->bytes[i], n, b[i]);
+        }
+
+        sent = b[1] & 0xf;
+        b[1] &= 0xf0;
+        ok = (lanes_t) (checksum(b) == sent) & 1;
+
+        lanes = batch->count - n;
+        if (lanes > SRTS_BATCH_LANES) {
+            lanes = SRTS_BATCH_LANES;
+        }
+        memcpy(flags, &ok, sizeof(flags));
+        for (j = 0; j < lanes; j++) {
+            total += flags[j];
+        }
+        if (valid != NULL) {
+            memcpy(valid + n, flags, lanes);
+        }
+    }
+
+    return total;
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2014 Sylvain Afchain
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef __SRTS_BATCH_H__
+#define __SRTS_BATCH_H__
+
+#include "srts.h"
+
+/* frames processed per vector operation */
+#define SRTS_BATCH_LANES 16
+
+/*
+ * Many frames stored as seven byte planes, byte i of frame n is bytes[i][n],
+ * so that the same byte of SRTS_BATCH_LANES frames is handled at once. The
+ * planes are padded to a multiple of SRTS_BATCH_LANES.
+ */
+struct srts_batch {
+    unsigned int count;
+    unsigned int size;
+    unsigned char *bytes[7];
+};
+
+int srts_batch_init(struct srts_batch *batch, unsigned int count);
+void srts_batch_free(struct srts_batch *batch);
+void srts_batch_set(struct srts_batch *batch, unsigned int n,
+        struct srts_payload *payload);
+void srts_batch_get(struct srts_batch *batch, unsigned int n,
+        struct srts_payload *payload);
+void srts_batch_encode(struct srts_batch *batch);
+unsigned int srts_batch_validate(struct srts_batch *batch,
+        unsigned char *valid);
+
+#endif
@@ -0,0 +1,433 @@
+/*
+ * Copyright (C) 2014 Sylvain Afchain
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+
+#include "srts.h"
+#include "srts_batch.h"
+#include "pulse.h"
+#include "samples.h"
+
+int verbose = 0;
+
+static void usage(char *name) {
+    printf("Usage: %s [--count <count>] [--rate <samples/s>] batch|drift|samples\n", name);
+    exit(-1);
+}
+
+static double now_ns() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void random_payload(struct srts_payload *payload) {
+    payload->key = rand() & 0xff;
+    payload->ctrl = rand() & 0xf;
+    payload->checksum = 0;
+    payload->code = rand() & 0xffff;
+    payload->address.byte1 = rand() & 0xff;
+    payload->address.byte2 = rand() & 0xff;
+    payload->address.byte3 = rand() & 0xff;
+}
+
+/* scalar srts_encode/srts_decode per frame against the batch kernels */
+static int bench_batch(unsigned int count) {
+    struct srts_payload *payloads, payload;
+    struct srts_batch batch;
+    unsigned int n, scalar_valid = 0, batch_valid;
+    unsigned char *valid;
+    double start, scalar_encode, scalar_validate, batch_encode,
+           batch_validate;
+
+    payloads = (struct srts_payload *) malloc(count * sizeof(struct srts_payload));
+    valid = (unsigned char *) malloc(count);
+    if (payloads == NULL || valid == NULL || srts_batch_init(&batch, count) == -1) {
+        fprintf(stderr, "Memory allocation error\n");
+        return -1;
+    }
+
+    for (n = 0; n != count; n++) {
+        random_payload(&payloads[n]);
+        srts_batch_set(&batch, n, &payloads[n]);
+    }
+
+    start = now_ns();
+    for (n = 0; n != count; n++) {
+        srts_encode(&payloads[n]);
+    }
+    scalar_encode = now_ns() - start;
+
+    start = now_ns();
+    srts_batch_encode(&batch);
+    batch_encode = now_ns() - start;
+
+    for (n = 0; n != count; n++) {
+        srts_batch_get(&batch, n, &payload);
+        if (memcmp(&payload, &payloads[n], 7) != 0) {
+            fprintf(stderr, "Batch encoding differs on frame %u\n", n);
+            return -1;
+        }
+
+        /* corrupt one frame out of eight, in both copies */
+        if (n % 8 == 7) {
+            ((unsigned char *) &payloads[n])[n % 7] ^= 1 << (n % 5);
+            srts_batch_set(&batch, n, &payloads[n]);
+        }
+    }
+
+    start = now_ns();
+    for (n = 0; n != count; n++) {
+        scalar_valid += srts_decode((char *) &payloads[n], &payload);
+    }
+    scalar_validate = now_ns() - start;
+
+    start = now_ns();
+    batch_valid = srts_batch_validate(&batch, valid);
+    batch_validate = now_ns() - start;
+
+    if (scalar_valid != batch_valid) {
+        fprintf(stderr, "Batch validation differs: %u valid, expected %u\n",
+                batch_valid, scalar_valid);
+        return -1;
+    }
+
+    printf("frames: %u, valid: %u\n", count, batch_valid);
+    printf("encode scalar: %.2f ns/frame, batch: %.2f ns/frame, x%.1f\n",
+            scalar_encode / count, batch_encode / count,
+            scalar_encode / batch_encode);
+    printf("validate scalar: %.2f ns/frame, batch: %.2f ns/frame, x%.1f\n",
+            scalar_validate / count, batch_validate / count,
+            scalar_validate / batch_validate);
+
+    srts_batch_free(&batch);
+    free(payloads);
+    free(valid);
+
+    return 0;
+}
+
+/* pulses of one frame, every width scaled by drift percent plus some jitter */
+static unsigned int drift_frame(struct timeline *timeline, struct pulse *pulses,
+        int drift) {
+    unsigned long long end;
+    unsigned int i;
+    int duration;
+
+    for (i = 0; i != timeline->count; i++) {
+        if (i + 1 == timeline->count) {
+            end = timeline->length_ns;
+        } else {
+            end = timeline->edges[i + 1].offset_ns;
+        }
+        duration = (end - timeline->edges[i].offset_ns) / 1000;
+        duration = duration * (100 + drift) / 100;
+        duration += duration * (rand() % 5 - 2) / 100;
+
+        pulses[i].type = timeline->edges[i].level;
+        pulses[i].duration = duration;
+    }
+
+    return timeline->count;
+}
+
+/* decode rate of frames sent by a transmitter with a drifting symbol clock */
+static int bench_drift(unsigned int count) {
+    struct srts_decoder decoder;
+    struct srts_payload payload;
+    struct timeline timeline;
+    struct pulse *pulses;
+    unsigned short *addresses;
+    unsigned int n, p, total, edges, decoded;
+    int drift, calibrate;
+    double start, elapsed;
+
+    pulses = (struct pulse *) malloc(count * 256 * sizeof(struct pulse));
+    addresses = (unsigned short *) malloc(count * sizeof(unsigned short));
+    if (pulses == NULL || addresses == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        return -1;
+    }
+    timeline_init(&timeline);
+
+    printf("%8s %12s %10s %12s %10s\n", "drift", "calibrated", "ns/edge",
+            "fixed", "ns/edge");
+    for (drift = -15; drift <= 15; drift += 5) {
+        total = 0;
+        for (n = 0; n != count; n++) {
+            addresses[n] = rand() & 0xffff;
+
+            timeline_clear(&timeline);
+            srts_compile(&timeline, rand() & 0xff, addresses[n], UP,
+                    rand() & 0xffff, n % 2);
+            total += drift_frame(&timeline, pulses + total, drift);
+        }
+
+        printf("%7d%%", drift);
+        for (calibrate = 1; calibrate >= 0; calibrate--) {
+            srts_decoder_init(&decoder);
+            decoder.ook.calibrate = calibrate;
+
+            decoded = edges = 0;
+            start = now_ns();
+            for (p = 0; p != total; p++) {
+                if (srts_decoder_feed(&decoder, pulses[p].type,
+                            pulses[p].duration, &payload) &&
+                        decoded < count && (payload.address.byte1 |
+                            payload.address.byte2 << 8) == addresses[decoded]) {
+                    decoded++;
+                }
+                edges++;
+            }
+            elapsed = now_ns() - start;
+
+            printf(" %11.1f%% %10.2f", decoded * 100.0 / count,
+                    elapsed / edges);
+        }
+        printf("\n");
+    }
+
+    timeline_free(&timeline);
+    free(addresses);
+    free(pulses);
+
+    return 0;
+}
+
+struct pulses {
+    struct pulse *pulses;
+    unsigned int count;
+    unsigned int size;
+};
+
+static void add_pulse(int type, unsigned int duration, void *arg) {
+    struct pulses *pulses = (struct pulses *) arg;
+
+    if (pulses->count != pulses->size) {
+        pulses->pulses[pulses->count].type = type;
+        pulses->pulses[pulses->count].duration = duration;
+    }
+    pulses->count++;
+}
+
+/* a timeline as sampled by a receiver, one byte per sample, and packed */
+static unsigned long long render_samples(struct timeline *timeline,
+        unsigned int rate, unsigned char **u8, unsigned char **bits) {
+    unsigned long long count, n, from, to;
+    unsigned int i;
+    int level;
+
+    count = timeline->length_ns * rate / 1000000000ULL;
+    *u8 = (unsigned char *) malloc(count);
+    *bits = (unsigned char *) calloc((count + 7) / 8, 1);
+    if (*u8 == NULL || *bits == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        exit(-1);
+    }
+
+    for (i = 0; i != timeline->count; i++) {
+        level = timeline->edges[i].level;
+        from = timeline->edges[i].offset_ns * rate / 1000000000ULL;
+        if (i + 1 == timeline->count) {
+            to = count;
+        } else {
+            to = timeline->edges[i + 1].offset_ns * rate / 1000000000ULL;
+        }
+        for (n = from; n != to; n++) {
+            /* some noise, never crossing the threshold */
+            (*u8)[n] = level ? 156 + rand() % 100 : rand() % 100;
+            if (level) {
+                (*bits)[n / 8] |= 0x80 >> (n % 8);
+            }
+        }
+    }
+
+    return count;
+}
+
+/* sample by sample, the reference for the vector scan */
+static void scalar_scan(const unsigned char *u8, unsigned long long count,
+        unsigned int rate, struct pulses *pulses) {
+    unsigned long long n, us, last_us = 0;
+    int level = 0, started = 0;
+
+    for (n = 0; n != count; n++) {
+        if ((u8[n] >= 128) != level) {
+            us = n * 1000000 / rate;
+            if (started) {
+                add_pulse(level, us - last_us, pulses);
+            }
+            started = 1;
+            last_us = us;
+            level = ! level;
+        }
+    }
+}
+
+static int check_pulses(const char *name, struct pulses *pulses,
+        struct pulses *expected) {
+    if (pulses->count != expected->count || memcmp(pulses->pulses,
+                expected->pulses, pulses->count * sizeof(struct pulse)) != 0) {
+        fprintf(stderr, "%s scan differs from the reference: %u edges, "
+                "expected %u\n", name, pulses->count, expected->count);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* edge extraction from sample streams, checked against a scalar scan */
+static int bench_samples(unsigned int count, unsigned int rate) {
+    struct pulses reference, vector, packed;
+    struct srts_decoder decoder;
+    struct srts_payload payload;
+    struct timeline timeline;
+    struct samples samples;
+    unsigned long long total;
+    unsigned char *u8, *bits;
+    unsigned int n, decoded = 0;
+    double start, scalar, u8_ns, bits_ns;
+
+    timeline_init(&timeline);
+    for (n = 0; n != count; n++) {
+        srts_compile(&timeline, rand() & 0xff, rand() & 0xffff, UP,
+                rand() & 0xffff, n != 0);
+    }
+    total = render_samples(&timeline, rate, &u8, &bits);
+
+    memset(&reference, 0, sizeof(reference));
+    reference.size = timeline.count;
+    reference.pulses = (struct pulse *) calloc(reference.size,
+            sizeof(struct pulse));
+    vector = packed = reference;
+    vector.pulses = (struct pulse *) calloc(reference.size, sizeof(struct pulse));
+    packed.pulses = (struct pulse *) calloc(reference.size, sizeof(struct pulse));
+    if (reference.pulses == NULL || vector.pulses == NULL ||
+            packed.pulses == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        return -1;
+    }
+
+    start = now_ns();
+    scalar_scan(u8, total, rate, &reference);
+    scalar = now_ns() - start;
+
+    samples_init(&samples, SAMPLES_U8, rate, 128, add_pulse, &vector);
+    start = now_ns();
+    samples_scan(&samples, u8, total);
+    u8_ns = now_ns() - start;
+
+    samples_init(&samples, SAMPLES_BIT, rate, 0, add_pulse, &packed);
+    start = now_ns();
+    samples_scan(&samples, bits, (total + 7) / 8);
+    bits_ns = now_ns() - start;
+
+    /* the padding of the last packed byte is low, as the trailing gap */
+    if (check_pulses("u8", &vector, &reference) == -1 ||
+            check_pulses("bit", &packed, &reference) == -1) {
+        return -1;
+    }
+
+    srts_decoder_init(&decoder);
+    for (n = 0; n != reference.count; n++) {
+        if (srts_decoder_feed(&decoder, reference.pulses[n].type,
+                    reference.pulses[n].duration, &payload) == 1) {
+            decoded++;
+        }
+    }
+    if (decoded != count) {
+        fprintf(stderr, "%u frames decoded out of %u\n", decoded, count);
+        return -1;
+    }
+
+    printf("samples: %llu at %u samples/s, edges: %u, frames: %u\n", total,
+            rate, reference.count, decoded);
+    printf("scalar: %.1f Msamples/s\n", total / scalar * 1e3);
+    printf("u8: %.1f Msamples/s, x%.1f\n", total / u8_ns * 1e3, scalar / u8_ns);
+    printf("bit: %.1f Msamples/s, x%.1f\n", total / bits_ns * 1e3,
+            scalar / bits_ns);
+
+    timeline_free(&timeline);
+    free(reference.pulses);
+    free(vector.pulses);
+    free(packed.pulses);
+    free(u8);
+    free(bits);
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    struct option long_options[] = { { "count", 1, 0, 0 },
+        { "rate", 1, 0, 0 }, { NULL, 0, 0, 0 } };
+    unsigned int count = 0, rate = 2000000;
+    long int a2i;
+    char *end;
+    int i, c;
+
+    while (1) {
+        c = getopt_long(argc, argv, "", long_options, &i);
+        if (c == -1)
+            break;
+        switch (c) {
+            case 0:
+                if (strcmp(long_options[i].name, "count") == 0) {
+                    a2i = strtol(optarg, &end, 10);
+                    if (errno == ERANGE && (a2i == LONG_MAX || a2i == LONG_MIN)) {
+                        break;
+                    }
+                    count = a2i;
+                } else if (strcmp(long_options[i].name, "rate") == 0) {
+                    a2i = strtol(optarg, &end, 10);
+                    if (errno == ERANGE && (a2i == LONG_MAX || a2i == LONG_MIN)) {
+                        break;
+                    }
+                    if (a2i <= 0) {
+                        usage(argv[0]);
+                    }
+                    rate = a2i;
+                }
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    if (optind != argc - 1) {
+        usage(argv[0]);
+    }
+
+    srand(time(NULL));
+
+    if (strcmp(argv[optind], "batch") == 0) {
+        return bench_batch(count ? count : 1000000);
+    } else if (strcmp(argv[optind], "drift") == 0) {
+        return bench_drift(count ? count : 1000);
+    } else if (strcmp(argv[optind], "samples") == 0) {
+        return bench_samples(count ? count : 50, rate);
+    }
+    usage(argv[0]);
+
+    return 0;
+}
@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2014 Sylvain Afchain
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "srts.h"
+#include "ook_protocols.h"
+#include "telemetry.h"
+
+extern int verbose;
+
+static void unfuscate_payload(char *bytes, struct srts_payload *payload) {
+    unsigned char *p;
+    int i = 0;
+
+    p = (unsigned char *) payload;
+
+    p[0] = bytes[0];
+    for (i = 1; i < 7; i++) {
+        p[i] = bytes[i] ^ bytes[i - 1];
+    }
+}
+
+static int validate_checksum(struct srts_payload *payload) {
+    unsigned char *p = (unsigned char *) payload;
+    unsigned char payload_chk = payload->checksum;
+    unsigned char checksum = 0;
+    int i = 0;
+
+    payload->checksum = 0;
+    for (i = 0; i < 7; i++) {
+        checksum = checksum ^ p[i] ^ (p[i] >> 4);
+    }
+    checksum = checksum & 0xf;
+
+    payload->checksum = payload_chk;
+    if (payload_chk == checksum) {
+        return 1;
+    }
+
+    return 0;
+}
+
+/* unfuscate received bytes, returns 1 when the checksum is valid */
+int srts_decode(char *bytes, struct srts_payload *payload) {
+    unfuscate_payload(bytes, payload);
+
+    return validate_checksum(payload);
+}
+
+void srts_decoder_init(struct srts_decoder *decoder) {
+    memset(decoder, 0, sizeof(struct srts_decoder));
+    ook_decoder_init(&decoder->ook, &srts_ook);
+    decoder->half = SRTS_HALF_BIT;
+}
+
+void srts_decoder_reset(struct srts_decoder *decoder) {
+    ook_decoder_reset(&decoder->ook);
+}
+
+static unsigned int payload_address(struct srts_payload *payload) {
+    return payload->address.byte1 | payload->address.byte2 << 8 |
+        payload->address.byte3 << 16;
+}
+
+/* learned half bit duration of a transmitter, 0 when never heard */
+unsigned int srts_decoder_clock(struct srts_decoder *decoder,
+        unsigned int address) {
+    struct srts_clock *clock = &decoder->clocks[address % SRTS_CLOCKS];
+
+    if (clock->address != address) {
+        return 0;
+    }
+
+    return clock->half;
+}
+
+static void learn_clock(struct srts_decoder *decoder, unsigned int address) {
+    struct srts_clock *clock = &decoder->clocks[address % SRTS_CLOCKS];
+
+    if (clock->address != address || clock->half == 0) {
+        clock->address = address;
+        clock->half = decoder->half;
+    } else {
+        clock->half = (clock->half * 3 + decoder->half) / 4;
+    }
+}
+
+int srts_decoder_feed(struct srts_decoder *decoder, int type, int duration,
+        struct srts_payload *payload) {
+    int rtv;
+
+    switch (ook_decoder_feed(&decoder->ook, &srts_ook, type, duration)) {
+        case OOK_SYNC:
+            /* the clock of the transmitter, measured on the syncs */
+            decoder->half = ook_scaled(&decoder->ook, &srts_ook,
+                    SRTS_HALF_BIT);
+            TELEMETRY_INC(decoder->syncs);
+            if (verbose) {
+                fprintf(stderr, "Found the sync part of a message\n");
+            }
+            return 0;
+        case OOK_FRAME:
+            break;
+        case OOK_ERROR:
+            if (verbose) {
+                fprintf(stderr, "Error while reading a bit\n");
+            }
+            TELEMETRY_INC(decoder->sync_losses);
+            return -1;
+        default:
+            return decoder->ook.state == OOK_BITS ? 0 : -1;
+    }
+
+    rtv = srts_decode((char *) decoder->ook.bits, payload);
+    if (rtv == 0) {
+        TELEMETRY_INC(decoder->checksum_errors);
+        if (verbose) {
+            fprintf(stderr, "Checksum error\n");
+        }
+    } else {
+        TELEMETRY_INC(decoder->frames);
+        learn_clock(decoder, payload_address(payload));
+    }
+
+    return rtv;
+}
+
+int srts_receive(int type, int duration, struct srts_payload *payload) {
+    static struct srts_decoder decoder;
+    static int initialized = 0;
+
+    if (! initialized) {
+        srts_decoder_init(&decoder);
+        initialized = 1;
+    }
+
+    return srts_decoder_feed(&decoder, type, duration, payload);
+}
@@ -14,6 +14,8 @@
  * 02110-1301, USA.
  */
 
+#define _GNU_SOURCE
+
 #include <wiringPi.h>
 #include <stdio.h>
 #include <syslog.h>
@@ -31,115 +33,86 @@
 
 #include "common.h"
 #include "srts.h"
+#include "rolling_code.h"
+#include "client.h"
+#include "protocol.h"
+#include "serial.h"
+#include "rt.h"
 
-static unsigned short get_next_code(char *progname, unsigned short address) {
-    char *path, code[10];
-    FILE *fp;
-    int size;
-
-    size = snprintf(NULL, 0, "/var/lib/%s/%d", progname, address);
-    if ((path = (char *) malloc(size + 1)) == NULL) {
-        fprintf(stderr, "Memory allocation error\n");
-        exit(-1);
-    }
-    sprintf(path, "/var/lib/%s", progname);
-    if (mkpath(path, 0755) == -1) {
-        fprintf(stderr, "Unable to create the state path: %s\n", path);
-        exit(-1);
-    }
-    sprintf(path, "/var/lib/%s/%d", progname, address);
-
-    if ((fp = fopen(path, "r")) == NULL) {
-        return 1;
-    }
-
-    memset(code, sizeof(code), 0);
-    if (fgets(code, sizeof(code), fp) == NULL) {
-        fclose(fp);
-        return 1;
-    }
-    fclose(fp);
-
-    return ((unsigned short) atoi(code)) + 1;
+static void usage(char *name) {
+    printf(
+        "Usage: %s (--gpio <gpio pin> | --serial <device>) "
+        "(--address <remote address> --comand <command> | "
+        "--group <address>:<command>[,<address>:<command>]...) "
+        "[--dry-run[=<trace file>]] [--stats] [--spin-us <us>] [--rt <spec>]...\n",
+        name);
+    rt_usage(stdout);
+    exit(-1);
 }
 
-static void store_code(char *progname, unsigned short address, unsigned short new_code) {
-    char *path, code[10];
-    FILE *fp;
-    int size;
-
-    size = snprintf(NULL, 0, "/var/lib/%s/%d", progname, address);
-    if ((path = (char *) malloc(size + 1)) == NULL) {
-        fprintf(stderr, "Memory allocation error\n");
-        exit(-1);
-    }
-    sprintf(path, "/var/lib/%s", progname);
-    if (mkpath(path, 0755) == -1) {
-        fprintf(stderr, "Unable to create the state path: %s\n", path);
-        exit(-1);
-    }
-    sprintf(path, "/var/lib/%s/%d", progname, address);
-
-    if ((fp = fopen(path, "w+")) == NULL) {
-        fprintf(stderr, "Unable to open the state file: %s", path);
-        exit(-1);
-    }
+/*
+ * Hand the trains over to the transmit coprocessor, one command per target,
+ * only the first one with a wakeup.
+ */
+static int serial_send(const char *device, struct srts_target *targets,
+        unsigned int count, int stats) {
+    struct serial_command command;
+    struct serial_ack ack;
+    unsigned int i;
+    int fd;
 
-    sprintf(code, "%d\n", new_code);
-    if (fputs(code, fp) < 0) {
-        fclose(fp);
-        exit(-1);
+    if ((fd = serial_open(device)) == -1) {
+        return -1;
     }
 
-    fclose(fp);
-}
+    memset(&command, 0, sizeof(command));
+    command.protocol = PROTOCOL_SRTS;
+    command.seq = rand();
+    for (i = 0; i != count; i++) {
+        command.flags = i ? SERIAL_REPEATED : 0;
+        command.seq++;
+        command.address = targets[i].address;
+        command.command = targets[i].command;
+        command.key = targets[i].key;
+        command.code = targets[i].code;
+        command.frames = srts_command_frames(targets[i].command);
 
-static char get_command_char(char *command) {
-    if (strcasecmp(command, "my") == 0) {
-        return MY;
-    } else if (strcasecmp(command, "up") == 0) {
-        return UP;
-    } else if (strcasecmp(command, "my_up") == 0) {
-        return MY_UP;
-    } else if (strcasecmp(command, "down") == 0) {
-        return DOWN;
-    } else if (strcasecmp(command, "my_down") == 0) {
-        return MY_DOWN;
-    } else if (strcasecmp(command, "up_down") == 0) {
-        return UP_DOWN;
-    } else if (strcasecmp(command, "prog") == 0) {
-        return PROG;
-    } else if (strcasecmp(command, "sun_flag") == 0) {
-        return SUN_FLAG;
-    } else if (strcasecmp(command, "flag") == 0) {
-        return FLAG;
+        if (serial_transmit(fd, &command, &ack, command.frames * 250 + 1000)) {
+            close(fd);
+            return -1;
+        }
+        if (stats) {
+            printf("remote: %u, frames: %u, airtime: %u us, latest edge: %u us\n",
+                    targets[i].address, ack.frames, ack.airtime, ack.late);
+        }
     }
+    close(fd);
 
-    return UNKNOWN;
-}
-
-static void usage(char *name) {
-    printf(
-        "Usage: %s --gpio <gpio pin> --address <remote address> --comand <command>\n",
-        name);
-    exit(-1);
+    return 0;
 }
 
 int main(int argc, char **argv) {
     struct option long_options[] = { { "gpio", 1, 0, 0 },
-        { "address", 1, 0, 0 }, { "command", 1, 0, 0 }, { NULL, 0, 0, 0 } };
-    unsigned char key;
+        { "address", 1, 0, 0 }, { "command", 1, 0, 0 }, { "dry-run", 2, 0, 0 },
+        { "stats", 0, 0, 0 }, { "spin-us", 1, 0, 0 }, { "group", 1, 0, 0 },
+        { "serial", 1, 0, 0 }, { "rt", 1, 0, 0 }, { NULL, 0, 0, 0 } };
+    struct rolling_code_table codes;
+    struct rt_config rt;
+    static struct timeline_stats timeline_stats;
+    struct timeline timeline;
+    struct srts_target targets[SRTS_GROUP_MAX];
+    unsigned short addresses[SRTS_GROUP_MAX], codes_reserved[SRTS_GROUP_MAX];
     unsigned short address = 0;
-    unsigned short code = 0;
+    unsigned int count = 0, frames;
     long int a2i;
     int gpio = -1, i, c;
     char command = UNKNOWN;
-    char *progname, *end;
+    char *progname, *end, *trace = NULL, *command_name = NULL, *group = NULL;
+    char *spec, *saveptr, *serial = NULL;
+    char request[CLIENT_LINE_MAX], reply[CLIENT_LINE_MAX];
+    int dry_run = 0, stats = 0, tuned = 0, len = 0;
 
-    if (setuid(0)) {
-        perror("setuid");
-        return -1;
-    }
+    rt_init(&rt);
 
     while (1) {
         c = getopt_long(argc, argv, "", long_options, &i);
@@ -160,7 +133,33 @@ int main(int argc, char **argv) {
                     }
                     address = a2i;
                 } else if (strcmp(long_options[i].name, "command") == 0) {
-                    command = get_command_char(optarg);
+                    command = srts_command(optarg);
+                    command_name = optarg;
+                } else if (strcmp(long_options[i].name, "dry-run") == 0) {
+                    dry_run = 1;
+                    trace = optarg;
+                } else if (strcmp(long_options[i].name, "stats") == 0) {
+                    stats = 1;
+                    tuned = 1;
+                } else if (strcmp(long_options[i].name, "spin-us") == 0) {
+                    tuned = 1;
+                    a2i = strtol(optarg, &end, 10);
+                    if (errno == ERANGE && (a2i == LONG_MAX || a2i == LONG_MIN)) {
+                        break;
+                    }
+                    if (a2i < 0) {
+                        usage(argv[0]);
+                    }
+                    timeline_set_spin(a2i);
+                } else if (strcmp(long_options[i].name, "group") == 0) {
+                    group = optarg;
+                } else if (strcmp(long_options[i].name, "serial") == 0) {
+                    serial = optarg;
+                } else if (strcmp(long_options[i].name, "rt") == 0) {
+                    tuned = 1;
+                    if (rt_parse(&rt, optarg) == -1) {
+                        usage(argv[0]);
+                    }
                 }
                 break;
             default:
@@ -168,43 +167,134 @@ int main(int argc, char **argv) {
         }
     }
 
-    if (command == UNKNOWN || address == 0 || gpio == -1) {
-        usage(argv[0]);
+    if (group != NULL) {
+        if (command != UNKNOWN || address != 0) {
+            usage(argv[0]);
+        }
+
+        /* the request forwarded to domiotoolsd lists the targets as given */
+        len = snprintf(request, sizeof(request), "srts-group %d", gpio);
+        for (spec = strtok_r(group, ",", &saveptr); spec != NULL;
+                spec = strtok_r(NULL, ",", &saveptr)) {
+            if (count == SRTS_GROUP_MAX || srts_target(spec, &targets[count]) == -1) {
+                usage(argv[0]);
+            }
+            if (len < (int) sizeof(request)) {
+                len += snprintf(request + len, sizeof(request) - len, " %s", spec);
+            }
+            count++;
+        }
+        if (len < (int) sizeof(request)) {
+            len += snprintf(request + len, sizeof(request) - len, "\n");
+        }
+    } else if (command != UNKNOWN && address != 0) {
+        targets[0].address = address;
+        targets[0].command = command;
+        count = 1;
+
+        len = snprintf(request, sizeof(request), "srts %d %d %s\n", gpio,
+                address, command_name);
     }
 
-    // store pid and lock it
-    store_pid();
+    /* a request not fitting in a line would be cut by domiotoolsd */
+    if (count == 0 || (gpio == -1 && serial == NULL && ! dry_run) ||
+            len >= (int) sizeof(request)) {
+        usage(argv[0]);
+    }
 
     srand(time(NULL));
-    key = rand() % 255;
+    for (i = 0; i != count; i++) {
+        targets[i].key = rand() % 255;
+        addresses[i] = targets[i].address;
+    }
 
-    if (wiringPiSetup() == -1) {
-        fprintf(stderr, "Wiring Pi not installed");
-        return -1;
+    /* the state is left untouched, the frames are only compiled */
+    if (dry_run) {
+        for (i = 0; i != count; i++) {
+            targets[i].code = 1;
+        }
+    } else {
+        if (setuid(0)) {
+            perror("setuid");
+            return -1;
+        }
+
+        /* hand the command over to domiotoolsd when it is running */
+        if (serial == NULL && client_request(DOMIOTOOLSD_SOCKET, request,
+                    reply, sizeof(reply)) == 0) {
+            /* the transmission is timed by the daemon, not by this process */
+            if (tuned) {
+                fprintf(stderr, "Sent through domiotoolsd, --stats, --spin-us "
+                        "and --rt ignored\n");
+            }
+            if (strncmp(reply, "ok", 2) != 0) {
+                fprintf(stderr, "domiotoolsd: %s", reply);
+                return -1;
+            }
+            return 0;
+        }
+
+        // store pid and lock it
+        store_pid();
+
+        if (serial == NULL && wiringPiSetup() == -1) {
+            fprintf(stderr, "Wiring Pi not installed");
+            return -1;
+        }
+
+        openlog("srts", LOG_PID | LOG_CONS, LOG_USER);
+
+        progname = basename(argv[0]);
+
+        if (rolling_code_open(&codes, ROLLING_CODE_TABLE, progname,
+                ROLLING_CODE_SYNC_EACH) == -1) {
+            return -1;
+        }
+        rolling_code_reserve_group(&codes, addresses, codes_reserved, count);
+        rolling_code_close(&codes);
+        for (i = 0; i != count; i++) {
+            targets[i].code = codes_reserved[i];
+            syslog(LOG_INFO, "remote: %d, command: %d, code: %d\n",
+                   targets[i].address, targets[i].command, targets[i].code);
+        }
+        closelog();
     }
 
-    openlog("srts", LOG_PID | LOG_CONS, LOG_USER);
+    timeline_init(&timeline);
+    frames = srts_compile_group(&timeline, targets, count);
+    if (group != NULL) {
+        fprintf(stderr, "%u targets, %u frames, airtime: %.1f ms\n", count,
+                frames, timeline.length_ns / 1e6);
+    }
 
-    progname = basename(argv[0]);
+    timeline_stats_init(&timeline_stats);
 
-    code = get_next_code(progname, address);
-    syslog(LOG_INFO, "remote: %d, command: %d, code: %d\n", address, command,
-           code);
-    closelog();
+    if (dry_run) {
+        if (stats) {
+            timeline_play(&timeline, gpio, NULL, &timeline_stats);
+            timeline_stats_print(&timeline_stats, stdout);
+        } else if (trace == NULL) {
+            timeline_dump(&timeline, stdout);
+        } else if (timeline_save(&timeline, trace) == -1) {
+            fprintf(stderr, "Unable to write the trace file: %s\n", trace);
+            return -1;
+        }
 
-    piHiPri (99);
-    pinMode(gpio, OUTPUT);
-    srts_transmit(gpio, key, address, command, code, 0);
+        return 0;
+    }
 
-    c = 7;
-    if (command == PROG) {
-        c = 20;
+    /* the board keeps the timing, no real time priority needed here */
+    if (serial != NULL) {
+        return serial_send(serial, targets, count, stats);
     }
 
-    for (i = 0; i < c; i++) {
-        srts_transmit(gpio, key, address, command, code, 1);
+    rt_lock_memory(&rt);
+    rt_apply(&rt, RT_TRANSMIT);
+    pinMode(gpio, OUTPUT);
+    timeline_play(&timeline, gpio, digitalWrite, stats ? &timeline_stats : NULL);
+    if (stats) {
+        timeline_stats_print(&timeline_stats, stdout);
     }
-    store_code(progname, address, code);
 
     return 0;
 }
@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2014 Sylvain Afchain
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <stdio.h>
+
+#include "telemetry.h"
+
+/* prometheus text format, one sample per line */
+void telemetry_counter(FILE *fp, const char *name, int gpio,
+        const char *protocol, unsigned long value) {
+    if (protocol != NULL) {
+        fprintf(fp, "%s{gpio=\"%d\",protocol=\"%s\"} %lu\n", name, gpio,
+                protocol, value);
+    } else {
+        fprintf(fp, "%s{gpio=\"%d\"} %lu\n", name, gpio, value);
+    }
+}
+
+void telemetry_histogram(FILE *fp, const char *name, int gpio,
+        struct histogram *histogram) {
+    static const double quantiles[] = { 0.5, 0.9, 0.99, 1 };
+    unsigned int i;
+
+    for (i = 0; i != sizeof(quantiles) / sizeof(double); i++) {
+        fprintf(fp, "%s{gpio=\"%d\",quantile=\"%g\"} %llu\n", name, gpio,
+                quantiles[i], histogram_percentile(histogram,
+                quantiles[i] * 100));
+    }
+    fprintf(fp, "%s_sum{gpio=\"%d\"} %llu\n", name, gpio,
+            TELEMETRY_READ(histogram->sum));
+    fprintf(fp, "%s_count{gpio=\"%d\"} %lu\n", name, gpio,
+            TELEMETRY_READ(histogram->count));
+}
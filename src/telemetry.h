@@ -0,0 +1,38 @@
+/*
+ * Copyright (C) 2014 Sylvain Afchain
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef __TELEMETRY_H__
+#define __TELEMETRY_H__
+
+#include <stdio.h>
+
+#include "histogram.h"
+
+/*
+ * Counters have a single writer, the thread owning them, so a relaxed store
+ * is enough for a scraper thread to read them, no lock nor atomic add.
+ */
+#define TELEMETRY_INC(counter) \
+    __atomic_store_n(&(counter), (counter) + 1, __ATOMIC_RELAXED)
+#define TELEMETRY_READ(counter) \
+    __atomic_load_n(&(counter), __ATOMIC_RELAXED)
+
+void telemetry_counter(FILE *fp, const char *name, int gpio,
+        const char *protocol, unsigned long value);
+void telemetry_histogram(FILE *fp, const char *name, int gpio,
+        struct histogram *histogram);
+
+#endif
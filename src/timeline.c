@@ -0,0 +1,281 @@
+/*
+ * Copyright (C) 2014 Sylvain Afchain
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+
+#include "timeline.h"
+#include "trace.h"
+
+static unsigned long long spin_ns = TIMELINE_SPIN_US * 1000ULL;
+
+void timeline_init(struct timeline *timeline) {
+    memset(timeline, 0, sizeof(struct timeline));
+}
+
+void timeline_clear(struct timeline *timeline) {
+    timeline->count = 0;
+    timeline->length_ns = 0;
+}
+
+void timeline_free(struct timeline *timeline) {
+    free(timeline->edges);
+    timeline_init(timeline);
+}
+
+/* append a pulse of the given level, duration in micro seconds */
+void timeline_pulse(struct timeline *timeline, int level, unsigned int duration) {
+    struct timeline_edge *edge;
+    unsigned int bit = level ? 1 : 0;
+
+    if (timeline->count == 0 ||
+            timeline->edges[timeline->count - 1].level != bit) {
+        if (timeline->count == timeline->size) {
+            timeline->size = timeline->size ? timeline->size * 2 : 256;
+            timeline->edges = (struct timeline_edge *) realloc(timeline->edges,
+                    timeline->size * sizeof(struct timeline_edge));
+            if (timeline->edges == NULL) {
+                fprintf(stderr, "Memory allocation error\n");
+                exit(-1);
+            }
+        }
+
+        edge = &timeline->edges[timeline->count++];
+        edge->level = bit;
+        edge->offset_ns = timeline->length_ns;
+    }
+
+    timeline->length_ns += (unsigned long long) duration * 1000;
+}
+
+static unsigned long long edge_width(struct timeline *timeline, unsigned int i) {
+    if (i + 1 == timeline->count) {
+        return timeline->length_ns - timeline->edges[i].offset_ns;
+    }
+
+    return timeline->edges[i + 1].offset_ns - timeline->edges[i].offset_ns;
+}
+
+static void deadline_add(struct timespec *deadline, struct timespec *start,
+        unsigned long long offset_ns) {
+    deadline->tv_sec = start->tv_sec + offset_ns / 1000000000;
+    deadline->tv_nsec = start->tv_nsec + offset_ns % 1000000000;
+    if (deadline->tv_nsec >= 1000000000) {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000;
+    }
+}
+
+static unsigned long long elapsed_ns(struct timespec *start,
+        struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) * 1000000000ULL +
+        end->tv_nsec - start->tv_nsec;
+}
+
+static int is_before(struct timespec *a, struct timespec *b) {
+    return a->tv_sec < b->tv_sec ||
+        (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+/* 0 sleeps through every wait, never spinning */
+void timeline_set_spin(unsigned int spin_us) {
+    spin_ns = spin_us * 1000ULL;
+}
+
+/*
+ * The scheduler wakes us up late by tens of micro seconds, so sleep only
+ * until the spin threshold and poll the clock for the last slice.
+ */
+static void wait_until(struct timespec *deadline) {
+    struct timespec now, wakeup;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (! is_before(&now, deadline)) {
+        return;
+    }
+
+    if (elapsed_ns(&now, deadline) > spin_ns) {
+        wakeup = *deadline;
+        wakeup.tv_sec -= spin_ns / 1000000000;
+        wakeup.tv_nsec -= spin_ns % 1000000000;
+        if (wakeup.tv_nsec < 0) {
+            wakeup.tv_sec--;
+            wakeup.tv_nsec += 1000000000;
+        }
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wakeup,
+                NULL) == EINTR);
+    }
+
+    do {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    } while (is_before(&now, deadline));
+}
+
+static struct timeline_symbol *symbol_of(struct timeline_stats *stats,
+        unsigned int width) {
+    unsigned int i;
+
+    for (i = 0; i != stats->count; i++) {
+        if (stats->symbols[i].width == width) {
+            return &stats->symbols[i];
+        }
+    }
+
+    /* too many different widths, the last symbol gathers the others */
+    if (stats->count == TIMELINE_SYMBOLS) {
+        stats->symbols[TIMELINE_SYMBOLS - 1].width = 0;
+        return &stats->symbols[TIMELINE_SYMBOLS - 1];
+    }
+    stats->symbols[stats->count].width = width;
+
+    return &stats->symbols[stats->count++];
+}
+
+static void record_pulse(struct timeline_stats *stats, unsigned long long intended,
+        unsigned long long actual) {
+    struct timeline_symbol *symbol;
+
+    symbol = symbol_of(stats, intended / 1000);
+    if (actual < intended) {
+        symbol->early++;
+        histogram_add(&symbol->error, intended - actual);
+    } else {
+        symbol->late++;
+        histogram_add(&symbol->error, actual - intended);
+    }
+}
+
+/*
+ * Without write function only the timing is played, to check the accuracy
+ * of a box without driving any output.
+ */
+void timeline_play(struct timeline *timeline, int gpio,
+        void (*write)(int gpio, int level), struct timeline_stats *stats) {
+    struct timespec start, deadline, cpu_start, cpu_end, *edges = NULL;
+    unsigned long long cpu;
+    unsigned int i;
+
+    /* the edges are only timestamped here, the stats are built afterwards */
+    if (stats != NULL) {
+        edges = (struct timespec *) malloc((timeline->count + 1) *
+                sizeof(struct timespec));
+        if (edges == NULL) {
+            fprintf(stderr, "Memory allocation error\n");
+            exit(-1);
+        }
+    }
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_start);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (i = 0; i != timeline->count; i++) {
+        deadline_add(&deadline, &start, timeline->edges[i].offset_ns);
+        wait_until(&deadline);
+        if (write != NULL) {
+            write(gpio, timeline->edges[i].level);
+        }
+        if (edges != NULL) {
+            clock_gettime(CLOCK_MONOTONIC, &edges[i]);
+        }
+    }
+
+    deadline_add(&deadline, &start, timeline->length_ns);
+    wait_until(&deadline);
+
+    if (edges != NULL) {
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_end);
+        cpu = elapsed_ns(&cpu_start, &cpu_end);
+        histogram_add(&stats->cpu, cpu);
+        stats->cpu_ns += cpu;
+        stats->wall_ns += timeline->length_ns;
+
+        clock_gettime(CLOCK_MONOTONIC, &edges[i]);
+        for (i = 0; i != timeline->count; i++) {
+            record_pulse(stats, edge_width(timeline, i),
+                    elapsed_ns(&edges[i], &edges[i + 1]));
+        }
+        free(edges);
+    }
+}
+
+void timeline_dump(struct timeline *timeline, FILE *fp) {
+    unsigned int i;
+
+    fprintf(fp, "# level offset_ns width_ns\n");
+    for (i = 0; i != timeline->count; i++) {
+        fprintf(fp, "%u %llu %llu\n", timeline->edges[i].level,
+                timeline->edges[i].offset_ns, edge_width(timeline, i));
+    }
+    fprintf(fp, "# %u edges, %llu ns\n", timeline->count, timeline->length_ns);
+}
+
+/* save as an edge trace, so that signal_replay can decode it */
+int timeline_save(struct timeline *timeline, const char *path) {
+    unsigned int i;
+    FILE *fp;
+
+    if ((fp = trace_create(path)) == NULL) {
+        return -1;
+    }
+
+    for (i = 0; i != timeline->count; i++) {
+        if (trace_write(fp, timeline->edges[i].level,
+                edge_width(timeline, i) / 1000) == -1) {
+            fclose(fp);
+            return -1;
+        }
+    }
+
+    return fclose(fp);
+}
+
+void timeline_stats_init(struct timeline_stats *stats) {
+    memset(stats, 0, sizeof(struct timeline_stats));
+}
+
+void timeline_stats_print(struct timeline_stats *stats, FILE *fp) {
+    struct timeline_symbol *symbol;
+    unsigned int i;
+
+    fprintf(fp, "%-10s %8s %10s %10s %10s %8s %8s\n", "symbol", "pulses",
+            "p50_us", "p99_us", "max_us", "early", "late");
+    for (i = 0; i != stats->count; i++) {
+        symbol = &stats->symbols[i];
+        if (symbol->width) {
+            fprintf(fp, "%8uus ", symbol->width);
+        } else {
+            fprintf(fp, "%10s ", "other");
+        }
+        fprintf(fp, "%8lu %10.1f %10.1f %10.1f %8lu %8lu\n",
+                symbol->error.count,
+                histogram_percentile(&symbol->error, 50) / 1000.0,
+                histogram_percentile(&symbol->error, 99) / 1000.0,
+                symbol->error.max / 1000.0,
+                symbol->early, symbol->late);
+    }
+
+    if (stats->cpu.count) {
+        fprintf(fp, "cpu per frame train: p50 %.1f us, p99 %.1f us, max %.1f us, "
+                "%.1f%% of airtime\n",
+                histogram_percentile(&stats->cpu, 50) / 1000.0,
+                histogram_percentile(&stats->cpu, 99) / 1000.0,
+                stats->cpu.max / 1000.0,
+                stats->cpu_ns * 100.0 / stats->wall_ns);
+    }
+}
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2014 Sylvain Afchain
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef __TIMELINE_H__
+#define __TIMELINE_H__
+
+#include <stdio.h>
+
+#include "histogram.h"
+
+struct timeline_edge {
+    unsigned int level;
+    unsigned long long offset_ns;
+};
+
+/*
+ * A whole waveform compiled ahead of transmission: every edge carries its
+ * offset from the start, so playback can aim at absolute deadlines and the
+ * error of one edge never shifts the following ones.
+ */
+struct timeline {
+    struct timeline_edge *edges;
+    unsigned int count;
+    unsigned int size;
+    unsigned long long length_ns;
+};
+
+/* symbols are told apart by their intended width, 1320us is two half bits */
+#define TIMELINE_SYMBOLS 16
+
+struct timeline_symbol {
+    unsigned int width;
+    unsigned long early;
+    unsigned long late;
+    struct histogram error;
+};
+
+/* actual against intended pulse widths, in nano seconds, over many plays */
+struct timeline_stats {
+    unsigned int count;
+    struct timeline_symbol symbols[TIMELINE_SYMBOLS];
+
+    /* cpu time burnt by each play against its length, in nano seconds */
+    struct histogram cpu;
+    unsigned long long cpu_ns;
+    unsigned long long wall_ns;
+};
+
+/*
+ * Waits sleep until this many micro seconds before a deadline and spin for
+ * the rest, so long gaps cost no cpu while edges stay accurate.
+ */
+#define TIMELINE_SPIN_US 200
+
+void timeline_init(struct timeline *timeline);
+void timeline_clear(struct timeline *timeline);
+void timeline_free(struct timeline *timeline);
+void timeline_pulse(struct timeline *timeline, int level, unsigned int duration);
+void timeline_set_spin(unsigned int spin_us);
+void timeline_play(struct timeline *timeline, int gpio,
+        void (*write)(int gpio, int level), struct timeline_stats *stats);
+void timeline_dump(struct timeline *timeline, FILE *fp);
+int timeline_save(struct timeline *timeline, const char *path);
+
+void timeline_stats_init(struct timeline_stats *stats);
+void timeline_stats_print(struct timeline_stats *stats, FILE *fp);
+
+#endif
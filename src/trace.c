@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2014 Sylvain Afchain
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <endian.h>
+#include <sys/stat.h>
+
+#include "trace.h"
+
+FILE *trace_create(const char *path) {
+    struct trace_header header;
+    FILE *fp;
+
+    if ((fp = fopen(path, "w")) == NULL) {
+        return NULL;
+    }
+
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = htole32(TRACE_VERSION);
+    if (fwrite(&header, sizeof(header), 1, fp) != 1) {
+        fclose(fp);
+        return NULL;
+    }
+
+    return fp;
+}
+
+int trace_write(FILE *fp, unsigned int type, unsigned int duration) {
+    unsigned int record;
+
+    record = duration & TRACE_DURATION;
+    if (type) {
+        record |= TRACE_LEVEL;
+    }
+    record = htole32(record);
+
+    if (fwrite(&record, sizeof(record), 1, fp) != 1) {
+        return -1;
+    }
+
+    return 0;
+}
+
+struct pulse *trace_load(const char *path, unsigned int *count) {
+    struct trace_header header;
+    struct pulse *pulses;
+    unsigned int *records, record;
+    struct stat st;
+    unsigned int i, n;
+    FILE *fp;
+
+    if ((fp = fopen(path, "r")) == NULL) {
+        fprintf(stderr, "Unable to open the trace file: %s\n", path);
+        return NULL;
+    }
+
+    if (fread(&header, sizeof(header), 1, fp) != 1 ||
+            memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0 ||
+            le32toh(header.version) != TRACE_VERSION) {
+        fprintf(stderr, "Not an edge trace file: %s\n", path);
+        fclose(fp);
+        return NULL;
+    }
+
+    if (fstat(fileno(fp), &st) == -1) {
+        fclose(fp);
+        return NULL;
+    }
+    n = (st.st_size - sizeof(header)) / sizeof(unsigned int);
+
+    records = (unsigned int *) malloc(n * sizeof(unsigned int) + 1);
+    pulses = (struct pulse *) malloc(n * sizeof(struct pulse) + 1);
+    if (records == NULL || pulses == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        exit(-1);
+    }
+
+    n = fread(records, sizeof(unsigned int), n, fp);
+    fclose(fp);
+
+    for (i = 0; i != n; i++) {
+        record = le32toh(records[i]);
+        pulses[i].type = (record & TRACE_LEVEL) != 0;
+        pulses[i].duration = record & TRACE_DURATION;
+        pulses[i].timestamp = 0;
+    }
+    free(records);
+
+    *count = n;
+
+    return pulses;
+}
@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2014 Sylvain Afchain
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stdio.h>
+
+#include "pulse.h"
+
+/*
+ * Edge trace file: a header followed by one little endian 32 bits record per
+ * edge, the level in the top bit and the duration in micro seconds below.
+ */
+#define TRACE_MAGIC "EDGE"
+#define TRACE_VERSION 1
+
+#define TRACE_LEVEL 0x80000000
+#define TRACE_DURATION 0x7fffffff
+
+struct trace_header {
+    char magic[4];
+    unsigned int version;
+};
+
+FILE *trace_create(const char *path);
+int trace_write(FILE *fp, unsigned int type, unsigned int duration);
+struct pulse *trace_load(const char *path, unsigned int *count);
+
+#endif
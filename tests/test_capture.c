@@ -0,0 +1,229 @@
+/*
+ * Copyright (C) 2014 Sylvain Afchain
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+
+/*
+ * The capture ring file: filled past its size, the edges read back must be
+ * the newest ones in order, the history must survive a reopen and its chunk
+ * sequence wrapping, and a time window must only keep the edges ending in it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "capture.h"
+#include "trace.h"
+
+/* 1 MB ring, a few times over */
+#define RING_MB 1
+#define EDGES 1500000
+/* a few hundred chunks */
+#define WRAP_EDGES 500000
+
+int verbose = 0;
+
+static unsigned int seed = 2463534242U;
+
+static unsigned int random32() {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+
+    return seed;
+}
+
+static unsigned int now_us() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (unsigned int) ts.tv_sec * 1000000U + ts.tv_nsec / 1000;
+}
+
+static unsigned long long wall_us() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+/* mostly short pulses, some long silences */
+static void make_pulses(struct pulse *pulses, unsigned int count) {
+    unsigned int i;
+
+    for (i = 0; i != count; i++) {
+        pulses[i].type = i & 1;
+        if (random32() % 100 == 0) {
+            pulses[i].duration = random32() % 100000000;
+        } else {
+            pulses[i].duration = 200 + random32() % 3000;
+        }
+    }
+}
+
+static int extract(const char *ring, const char *trace_path,
+        unsigned long long from, unsigned long long to, struct pulse **pulses,
+        unsigned int *count) {
+    FILE *trace;
+    int extracted;
+
+    if ((trace = trace_create(trace_path)) == NULL) {
+        perror(trace_path);
+        return -1;
+    }
+    extracted = capture_extract(ring, from, to, trace, NULL);
+    fclose(trace);
+    if (extracted == -1) {
+        return -1;
+    }
+
+    if ((*pulses = trace_load(trace_path, count)) == NULL ||
+            *count != (unsigned int) extracted) {
+        fprintf(stderr, "%d edges extracted, %u in the trace\n", extracted,
+                *count);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* the newest edges fed, in order */
+static int check_tail(const char *name, struct pulse *fed, unsigned int total,
+        struct pulse *read, unsigned int count) {
+    unsigned int i;
+
+    if (count == 0 || count > total) {
+        fprintf(stderr, "%s: %u edges read back out of %u\n", name, count,
+                total);
+        return -1;
+    }
+    for (i = 0; i != count; i++) {
+        if (read[i].type != fed[total - count + i].type ||
+                read[i].duration != fed[total - count + i].duration) {
+            fprintf(stderr, "%s: edge %u of %u differs\n", name, i, count);
+            return -1;
+        }
+    }
+    printf("%s: %u newest edges of %u read back\n", name, count, total);
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    char ring[] = "/tmp/test_capture.XXXXXX";
+    char trace_path[] = "/tmp/test_capture_trace.XXXXXX";
+    struct capture capture;
+    struct pulse *fed, *read;
+    unsigned long long start;
+    unsigned int count, i;
+    int fd, rtv = 0;
+
+    if ((fd = mkstemp(ring)) == -1 || close(fd) == -1 ||
+            (fd = mkstemp(trace_path)) == -1 || close(fd) == -1) {
+        perror("mkstemp");
+        return 1;
+    }
+    if ((fed = (struct pulse *) malloc(EDGES * sizeof(struct pulse))) ==
+            NULL) {
+        return 1;
+    }
+    make_pulses(fed, EDGES);
+    start = wall_us();
+
+    /* most of it, then the rest after a restart */
+    if (capture_open(&capture, ring, RING_MB) == -1) {
+        return 1;
+    }
+    for (i = 0; i != EDGES - 1000; i++) {
+        capture_edge(&capture, fed[i].type, fed[i].duration, now_us());
+    }
+    capture_close(&capture);
+
+    if (capture_open(&capture, ring, RING_MB) == -1) {
+        return 1;
+    }
+    for (; i != EDGES; i++) {
+        capture_edge(&capture, fed[i].type, fed[i].duration, now_us());
+    }
+    capture_close(&capture);
+
+    if (extract(ring, trace_path, 0, ~0ULL, &read, &count) == -1) {
+        rtv = 1;
+    } else {
+        rtv |= check_tail("whole ring", fed, EDGES, read, count);
+        free(read);
+    }
+
+    /* the edges end after the test started, whatever their duration */
+    if (extract(ring, trace_path, start, ~0ULL, &read, &count) == -1) {
+        rtv = 1;
+    } else {
+        rtv |= check_tail("window", fed, EDGES, read, count);
+        free(read);
+    }
+    if (extract(ring, trace_path, 0, start - 1000000, &read, &count) == -1) {
+        rtv = 1;
+    } else {
+        if (count != 0) {
+            fprintf(stderr, "before: %u edges ending before the test\n",
+                    count);
+            rtv = 1;
+        }
+        free(read);
+    }
+
+    /* another size starts over */
+    if (capture_open(&capture, ring, RING_MB * 2) == -1) {
+        return 1;
+    }
+    capture_edge(&capture, 1, 1234, now_us());
+    capture_close(&capture);
+    if (extract(ring, trace_path, 0, ~0ULL, &read, &count) == -1) {
+        rtv = 1;
+    } else {
+        if (count != 1 || read[0].type != 1 || read[0].duration != 1234) {
+            fprintf(stderr, "resized: %u edges, the old ones kept\n", count);
+            rtv = 1;
+        }
+        free(read);
+    }
+
+    /* the chunk sequence wrapping around in the ring */
+    if (capture_open(&capture, ring, RING_MB) == -1) {
+        return 1;
+    }
+    capture.seq = 0U - 100;
+    for (i = 0; i != WRAP_EDGES; i++) {
+        capture_edge(&capture, fed[i].type, fed[i].duration, now_us());
+    }
+    capture_close(&capture);
+    if (extract(ring, trace_path, 0, ~0ULL, &read, &count) == -1) {
+        rtv = 1;
+    } else {
+        rtv |= check_tail("wrapped", fed, WRAP_EDGES, read, count);
+        free(read);
+    }
+
+    free(fed);
+    unlink(ring);
+    unlink(trace_path);
+
+    return rtv ? 1 : 0;
+}
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2014 Sylvain Afchain
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+
+/*
+ * Commands repeated at the same time whose keys fall in the same set of the
+ * dedupe cache, each one must still come out as a single event.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "dedupe.h"
+
+/* within the Somfy repeat window of each command */
+#define SPACING 100000
+#define REPEATS 8
+
+int verbose = 0;
+
+static struct dedupe_event events[DEDUPE_WAYS + 1];
+static unsigned int count;
+
+static void output(struct dedupe_event *event, void *arg) {
+    if (count != DEDUPE_WAYS + 1) {
+        events[count] = *event;
+    }
+    count++;
+}
+
+static void somfy_frame(struct frame *frame, unsigned int address) {
+    memset(frame, 0, sizeof(struct frame));
+    frame->protocol = PROTOCOL_SRTS;
+    frame->srts.address.byte1 = address;
+    frame->srts.address.byte2 = address >> 8;
+    frame->srts.address.byte3 = address >> 16;
+}
+
+/* the addresses of remotes sharing the set of the first one */
+static void colliding(struct frame *frames, unsigned int n) {
+    unsigned int set, address = 1, i = 1;
+
+    somfy_frame(&frames[0], address);
+    set = dedupe_set(dedupe_key(&frames[0]));
+    while (i != n) {
+        somfy_frame(&frames[i], ++address);
+        if (dedupe_set(dedupe_key(&frames[i])) == set) {
+            i++;
+        }
+    }
+}
+
+/* every command of the set repeated in turn, one event each */
+static int test_interleaved(const char *what, unsigned int n) {
+    struct frame frames[DEDUPE_WAYS + 1];
+    unsigned int now = 0, r, i;
+    struct dedupe dedupe;
+    int rtv = 0;
+
+    colliding(frames, n);
+
+    count = 0;
+    dedupe_init(&dedupe, output, NULL);
+    for (r = 0; r != REPEATS; r++) {
+        for (i = 0; i != n; i++) {
+            dedupe_frame(&dedupe, &frames[i], now);
+            now += SPACING / n;
+        }
+    }
+    dedupe_flush(&dedupe);
+
+    if (count != n || dedupe.evictions != 0) {
+        fprintf(stderr, "%s: %u events, %lu evictions\n", what, count,
+                dedupe.evictions);
+        return -1;
+    }
+    for (i = 0; i != n; i++) {
+        if (events[i].repeats != REPEATS) {
+            fprintf(stderr, "%s: event %u of %u repeats\n", what, i,
+                    events[i].repeats);
+            rtv = -1;
+        }
+    }
+
+    return rtv;
+}
+
+/* a set full of commands in flight, the oldest one gives way */
+static int test_oldest() {
+    struct frame frames[DEDUPE_WAYS + 1];
+    struct dedupe dedupe;
+    unsigned int i;
+
+    colliding(frames, DEDUPE_WAYS + 1);
+
+    count = 0;
+    dedupe_init(&dedupe, output, NULL);
+    for (i = 0; i != DEDUPE_WAYS + 1; i++) {
+        dedupe_frame(&dedupe, &frames[i], i * 1000);
+    }
+
+    if (count != 1 || dedupe.evictions != 1 ||
+            memcmp(&events[0].frame, &frames[0], sizeof(struct frame))) {
+        fprintf(stderr, "oldest: %u events, %lu evictions\n", count,
+                dedupe.evictions);
+        return -1;
+    }
+    dedupe_flush(&dedupe);
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    int rtv = 0;
+
+    rtv |= test_interleaved("two", 2);
+    rtv |= test_interleaved("full set", DEDUPE_WAYS);
+    rtv |= test_oldest();
+
+    return rtv;
+}
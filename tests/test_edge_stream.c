@@ -0,0 +1,279 @@
+/*
+ * Copyright (C) 2014 Sylvain Afchain
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+
+/*
+ * The receive front-end stream replayed through a pseudo terminal, as
+ * arduino/edges.ino would send it, with line garbage, a corrupted block and a
+ * lost one, then the same bytes read back from a recorded file. The frames
+ * decoded must be the ones of the pulses fed straight to the decoders.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+
+#include "srts.h"
+#include "homeasy.h"
+#include "protocol.h"
+#include "edge_stream.h"
+#include "serial.h"
+
+#define MAX_PULSES 8192
+#define MAX_STREAM 65536
+
+int verbose = 0;
+
+struct decoded {
+    struct protocol_dispatch dispatch;
+    struct pulse_filter filter;
+    unsigned int frames[PROTOCOL_COUNT];
+};
+
+struct line {
+    int master;
+    const unsigned char *bytes;
+    unsigned int len;
+    pthread_t thread;
+};
+
+static struct pulse pulses[MAX_PULSES];
+static unsigned int pulse_count;
+
+static unsigned char stream[MAX_STREAM];
+static unsigned int stream_len;
+
+static void add_timeline(struct timeline *timeline) {
+    unsigned long long end;
+    unsigned int i;
+
+    for (i = 0; i != timeline->count && pulse_count != MAX_PULSES; i++) {
+        end = i + 1 == timeline->count ? timeline->length_ns :
+            timeline->edges[i + 1].offset_ns;
+        pulses[pulse_count].type = timeline->edges[i].level;
+        pulses[pulse_count].duration =
+            (end - timeline->edges[i].offset_ns) / 1000;
+        pulse_count++;
+    }
+}
+
+static void add_bytes(const unsigned char *bytes, unsigned int len) {
+    memcpy(stream + stream_len, bytes, len);
+    stream_len += len;
+}
+
+/* every pulse in blocks, damaged on the way */
+static void build_stream() {
+    static const unsigned char garbage[] = { 0x00, EDGE_STREAM_MAGIC, 0x07,
+        0xff, 0x42 };
+    unsigned char block[EDGE_STREAM_BLOCK];
+    unsigned int first = 0, used, len, blocks = 0;
+    unsigned char seq = 250;
+
+    while (first != pulse_count) {
+        len = edge_stream_block(block, seq++, pulses + first,
+                pulse_count - first, &used);
+
+        switch (blocks++) {
+            case 2:
+                add_bytes(garbage, sizeof(garbage));
+                break;
+            case 5:
+                /* a copy with a bit flipped, before the good one */
+                block[EDGE_STREAM_HEADER + 3] ^= 0x10;
+                add_bytes(block, len);
+                block[EDGE_STREAM_HEADER + 3] ^= 0x10;
+                break;
+            case 8:
+                /* the numbering jumps, as when a block is dropped */
+                block[1] = seq++;
+                block[len - 1] = serial_crc8(block, len - 1);
+                break;
+        }
+        add_bytes(block, len);
+        first += used;
+    }
+}
+
+static void frame_handler(struct frame *frame, void *arg) {
+    struct decoded *decoded = (struct decoded *) arg;
+
+    decoded->frames[frame->protocol]++;
+}
+
+static void decoded_init(struct decoded *decoded) {
+    memset(decoded, 0, sizeof(struct decoded));
+    protocol_init(&decoded->dispatch, frame_handler, decoded);
+}
+
+static void decode(int type, unsigned int duration, void *arg) {
+    struct decoded *decoded = (struct decoded *) arg;
+
+    if (pulse_filter(&decoded->filter, duration, &duration)) {
+        protocol_feed(&decoded->dispatch, type, duration);
+    }
+}
+
+/* odd sized writes, blocks never arrive whole */
+static void *line_thread(void *arg) {
+    static const unsigned int chunks[] = { 1, 7, 64, 13, 250, 3, 509 };
+    struct line *line = (struct line *) arg;
+    unsigned int offset = 0, n, i = 0;
+
+    while (offset != line->len) {
+        n = chunks[i++ % (sizeof(chunks) / sizeof(chunks[0]))];
+        if (n > line->len - offset) {
+            n = line->len - offset;
+        }
+        if (write(line->master, line->bytes + offset, n) != n) {
+            break;
+        }
+        offset += n;
+    }
+
+    return NULL;
+}
+
+/* read as signal_eventd does, until the end of the file or of the line */
+static void read_stream(int fd, struct edge_stream *edges) {
+    unsigned char buffer[4096];
+    struct pollfd pfd;
+    ssize_t len;
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    while (poll(&pfd, 1, 1000) > 0 &&
+            (len = read(fd, buffer, sizeof(buffer))) > 0) {
+        edge_stream_feed(edges, buffer, len);
+    }
+}
+
+static int check(const char *name, struct decoded *expected, int fd) {
+    struct edge_stream edges;
+    struct decoded decoded;
+
+    decoded_init(&decoded);
+    edge_stream_init(&edges, decode, &decoded);
+
+    read_stream(fd, &edges);
+
+    printf("%-8s blocks: %lu, records: %lu, lost: %lu, errors: %lu, "
+            "somfy: %u, homeasy: %u\n", name, edges.blocks, edges.records,
+            edges.lost, edges.errors, decoded.frames[PROTOCOL_SRTS],
+            decoded.frames[PROTOCOL_HOMEASY]);
+
+    if (edges.records != pulse_count || edges.lost != 1 || edges.errors < 2) {
+        fprintf(stderr, "%s: %u pulses, 1 block lost and 2 errors expected\n",
+                name, pulse_count);
+        return -1;
+    }
+    if (memcmp(decoded.frames, expected->frames, sizeof(decoded.frames))) {
+        fprintf(stderr, "%s: %u somfy and %u homeasy frames expected\n", name,
+                expected->frames[PROTOCOL_SRTS],
+                expected->frames[PROTOCOL_HOMEASY]);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int check_pty(struct decoded *expected) {
+    struct line line;
+    int fd, rtv;
+
+    if ((line.master = posix_openpt(O_RDWR | O_NOCTTY)) == -1 ||
+            grantpt(line.master) == -1 || unlockpt(line.master) == -1) {
+        perror("posix_openpt");
+        return -1;
+    }
+    if ((fd = serial_open(ptsname(line.master))) == -1) {
+        return -1;
+    }
+    line.bytes = stream;
+    line.len = stream_len;
+    pthread_create(&line.thread, NULL, line_thread, &line);
+
+    rtv = check("pty", expected, fd);
+
+    pthread_join(line.thread, NULL);
+    close(fd);
+    close(line.master);
+
+    return rtv;
+}
+
+static int check_file(struct decoded *expected) {
+    char path[] = "/tmp/test_edge_stream.XXXXXX";
+    int fd, rtv;
+
+    if ((fd = mkstemp(path)) == -1 ||
+            write(fd, stream, stream_len) != stream_len) {
+        perror(path);
+        return -1;
+    }
+    close(fd);
+
+    if ((fd = serial_open(path)) == -1) {
+        unlink(path);
+        return -1;
+    }
+    rtv = check("file", expected, fd);
+
+    close(fd);
+    unlink(path);
+
+    return rtv;
+}
+
+int main(int argc, char **argv) {
+    struct timeline timeline;
+    struct decoded expected;
+    unsigned int i;
+    int rtv = 0;
+
+    timeline_init(&timeline);
+    srts_compile(&timeline, 0xa7, 0xbeef, DOWN, 0x1234, 0);
+    for (i = 0; i != 7; i++) {
+        srts_compile(&timeline, 0xa7, 0xbeef, DOWN, 0x1234, 1);
+    }
+    for (i = 0; i != 5; i++) {
+        homeasy_compile(&timeline, 0x2abcdef, 3, HOMEASY_ON, 0);
+    }
+    add_timeline(&timeline);
+    timeline_free(&timeline);
+
+    build_stream();
+
+    decoded_init(&expected);
+    for (i = 0; i != pulse_count; i++) {
+        decode(pulses[i].type, pulses[i].duration, &expected);
+    }
+    if (expected.frames[PROTOCOL_SRTS] != 8 ||
+            expected.frames[PROTOCOL_HOMEASY] != 5) {
+        fprintf(stderr, "reference frames not decoded\n");
+        return 1;
+    }
+
+    rtv |= check_pty(&expected);
+    rtv |= check_file(&expected);
+
+    return rtv ? 1 : 0;
+}
@@ -0,0 +1,280 @@
+/*
+ * Copyright (C) 2014 Sylvain Afchain
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+
+/*
+ * Line events of the GPIO character device, as the kernel hands them out:
+ * fed in odd batches, then read back from a recorded event file as
+ * signal_eventd --events does, the pulses must be the ones of the timeline
+ * and decode to the same frames. A gap in the line sequence numbers must be
+ * counted as lost and never turned into a pulse.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "srts.h"
+#include "homeasy.h"
+#include "protocol.h"
+#include "pulse.h"
+#include "gpiochip.h"
+
+#define MAX_PULSES 8192
+
+/* nano seconds, past what 32 bits would hold */
+#define START_NS 5000000000123ULL
+
+/* events taken out of the middle of the first Somfy frame */
+#define GAP_AT 40
+#define GAP 3
+
+int verbose = 0;
+
+struct decoded {
+    struct protocol_dispatch dispatch;
+    struct pulse_filter filter;
+    unsigned int frames[PROTOCOL_COUNT];
+
+    struct pulse pulses[MAX_PULSES];
+    unsigned int count;
+};
+
+static struct pulse pulses[MAX_PULSES];
+static unsigned int pulse_count;
+
+/* an edge starting the first pulse, then the one ending every pulse */
+static struct gpio_v2_line_event events[MAX_PULSES + 1];
+static unsigned int event_count;
+
+static void add_timeline(struct timeline *timeline) {
+    unsigned long long end;
+    unsigned int i;
+
+    for (i = 0; i != timeline->count && pulse_count != MAX_PULSES; i++) {
+        end = i + 1 == timeline->count ? timeline->length_ns :
+            timeline->edges[i + 1].offset_ns;
+        pulses[pulse_count].type = timeline->edges[i].level;
+        pulses[pulse_count].duration =
+            (end - timeline->edges[i].offset_ns) / 1000;
+        pulse_count++;
+    }
+}
+
+static void build_events() {
+    unsigned long long now = START_NS;
+    unsigned int i;
+
+    memset(events, 0, sizeof(events));
+    events[0].timestamp_ns = now;
+    events[0].id = pulses[0].type ? GPIO_V2_LINE_EVENT_RISING_EDGE :
+        GPIO_V2_LINE_EVENT_FALLING_EDGE;
+    events[0].line_seqno = 1;
+
+    for (i = 0; i != pulse_count; i++) {
+        now += pulses[i].duration * 1000ULL;
+        events[i + 1].timestamp_ns = now;
+        events[i + 1].id = pulses[i].type ? GPIO_V2_LINE_EVENT_FALLING_EDGE :
+            GPIO_V2_LINE_EVENT_RISING_EDGE;
+        events[i + 1].line_seqno = i + 2;
+        events[i + 1].seqno = i + 2;
+    }
+    event_count = pulse_count + 1;
+}
+
+static void frame_handler(struct frame *frame, void *arg) {
+    struct decoded *decoded = (struct decoded *) arg;
+
+    decoded->frames[frame->protocol]++;
+}
+
+static void decoded_init(struct decoded *decoded) {
+    memset(decoded, 0, sizeof(struct decoded));
+    protocol_init(&decoded->dispatch, frame_handler, decoded);
+}
+
+static void decode(int type, unsigned int duration, unsigned int timestamp,
+        void *arg) {
+    struct decoded *decoded = (struct decoded *) arg;
+
+    if (decoded->count != MAX_PULSES) {
+        decoded->pulses[decoded->count].type = type;
+        decoded->pulses[decoded->count].duration = duration;
+        decoded->pulses[decoded->count].timestamp = timestamp;
+        decoded->count++;
+    }
+    if (pulse_filter(&decoded->filter, duration, &duration)) {
+        protocol_feed(&decoded->dispatch, type, duration);
+    }
+}
+
+/* count pulses of the timeline from first on, with their end time */
+static int check_pulses(const char *name, struct decoded *decoded,
+        unsigned int first, unsigned int count) {
+    unsigned long long end;
+    unsigned int i;
+
+    if (decoded->count != count) {
+        fprintf(stderr, "%s: %u pulses instead of %u\n", name,
+                decoded->count, count);
+        return -1;
+    }
+    for (i = 0; i != decoded->count; i++) {
+        end = events[first + i + 1].timestamp_ns / 1000;
+        if (decoded->pulses[i].type != pulses[first + i].type ||
+                decoded->pulses[i].duration != pulses[first + i].duration ||
+                decoded->pulses[i].timestamp != (unsigned int) end) {
+            fprintf(stderr, "%s: pulse %u differs\n", name, first + i);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int check_frames(const char *name, struct gpiochip_edges *edges,
+        struct decoded *decoded) {
+    printf("%-8s events: %lu, lost: %lu, pulses: %u, somfy: %u, "
+            "homeasy: %u\n", name, edges->events, edges->lost,
+            decoded->count, decoded->frames[PROTOCOL_SRTS],
+            decoded->frames[PROTOCOL_HOMEASY]);
+
+    if (edges->events != event_count || edges->lost != 0 ||
+            decoded->frames[PROTOCOL_SRTS] != 8 ||
+            decoded->frames[PROTOCOL_HOMEASY] != 5) {
+        fprintf(stderr, "%s: %u events, 8 somfy and 5 homeasy frames "
+                "expected\n", name, event_count);
+        return -1;
+    }
+
+    return check_pulses(name, decoded, 0, pulse_count);
+}
+
+/* batches of every size up to a whole read */
+static int check_batches() {
+    struct gpiochip_edges edges;
+    struct decoded decoded;
+    unsigned int offset = 0, n = 1;
+
+    decoded_init(&decoded);
+    gpiochip_edges_init(&edges, decode, &decoded);
+
+    while (offset != event_count) {
+        if (n > event_count - offset) {
+            n = event_count - offset;
+        }
+        gpiochip_edges_feed(&edges, events + offset, n);
+        offset += n;
+        n = n % GPIOCHIP_BATCH + 1;
+    }
+
+    return check_frames("batches", &edges, &decoded);
+}
+
+static int check_file() {
+    struct gpio_v2_line_event batch[GPIOCHIP_BATCH];
+    char path[] = "/tmp/test_gpiochip.XXXXXX";
+    struct gpiochip_edges edges;
+    struct decoded decoded;
+    int fd, count, rtv;
+
+    if ((fd = mkstemp(path)) == -1 ||
+            write(fd, events, event_count * sizeof(events[0])) !=
+            (ssize_t) (event_count * sizeof(events[0]))) {
+        perror(path);
+        return -1;
+    }
+    close(fd);
+
+    if ((fd = open(path, O_RDONLY)) == -1) {
+        perror(path);
+        unlink(path);
+        return -1;
+    }
+
+    decoded_init(&decoded);
+    gpiochip_edges_init(&edges, decode, &decoded);
+    while ((count = gpiochip_read(fd, batch)) > 0) {
+        gpiochip_edges_feed(&edges, batch, count);
+    }
+    close(fd);
+    unlink(path);
+
+    if (count == -1) {
+        perror("gpiochip_read");
+        return -1;
+    }
+    rtv = check_frames("file", &edges, &decoded);
+
+    return rtv;
+}
+
+/* the kernel buffer overflowed, the pulses resume after the next edge */
+static int check_gap() {
+    struct gpiochip_edges edges;
+    struct decoded decoded;
+
+    decoded_init(&decoded);
+    gpiochip_edges_init(&edges, decode, &decoded);
+
+    gpiochip_edges_feed(&edges, events, GAP_AT);
+    if (check_pulses("before gap", &decoded, 0, GAP_AT - 1) == -1) {
+        return -1;
+    }
+
+    decoded_init(&decoded);
+    gpiochip_edges_feed(&edges, events + GAP_AT + GAP,
+            event_count - GAP_AT - GAP);
+
+    printf("%-8s events: %lu, lost: %lu, pulses: %u\n", "gap", edges.events,
+            edges.lost, GAP_AT - 1 + decoded.count);
+
+    if (edges.lost != GAP || edges.events != event_count - GAP) {
+        fprintf(stderr, "gap: %lu events lost instead of %u\n", edges.lost,
+                GAP);
+        return -1;
+    }
+
+    return check_pulses("after gap", &decoded, GAP_AT + GAP,
+            pulse_count - GAP_AT - GAP);
+}
+
+int main(int argc, char **argv) {
+    struct timeline timeline;
+    unsigned int i;
+    int rtv = 0;
+
+    timeline_init(&timeline);
+    srts_compile(&timeline, 0xa7, 0xbeef, DOWN, 0x1234, 0);
+    for (i = 0; i != 7; i++) {
+        srts_compile(&timeline, 0xa7, 0xbeef, DOWN, 0x1234, 1);
+    }
+    for (i = 0; i != 5; i++) {
+        homeasy_compile(&timeline, 0x2abcdef, 3, HOMEASY_ON, 0);
+    }
+    add_timeline(&timeline);
+    timeline_free(&timeline);
+
+    build_events();
+
+    rtv |= check_batches();
+    rtv |= check_file();
+    rtv |= check_gap();
+
+    return rtv ? 1 : 0;
+}
@@ -0,0 +1,226 @@
+/*
+ * Copyright (C) 2014 Sylvain Afchain
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+
+/*
+ * Device registry files, the lookup of every kind of frame, a few hundred
+ * remotes, and the files that must be refused as a whole.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "registry.h"
+
+#define REMOTES 500
+
+int verbose = 0;
+
+static char path[] = "/tmp/test_registry.XXXXXX";
+
+static int write_file(const char *content) {
+    FILE *fp;
+    int fd;
+
+    strcpy(path, "/tmp/test_registry.XXXXXX");
+    if ((fd = mkstemp(path)) == -1 || (fp = fdopen(fd, "w")) == NULL) {
+        perror(path);
+        return -1;
+    }
+    fputs(content, fp);
+    fclose(fp);
+
+    return 0;
+}
+
+static struct registry *load(const char *content) {
+    struct registry *registry;
+
+    if (write_file(content) == -1) {
+        return NULL;
+    }
+    registry = registry_load(path);
+    unlink(path);
+
+    return registry;
+}
+
+static const char *somfy_name(struct registry *registry,
+        unsigned int address) {
+    const struct registry_device *device;
+    struct frame frame;
+
+    memset(&frame, 0, sizeof(frame));
+    frame.protocol = PROTOCOL_SRTS;
+    frame.srts.address.byte1 = address;
+    frame.srts.address.byte2 = address >> 8;
+    frame.srts.address.byte3 = address >> 16;
+
+    device = registry_lookup(registry, &frame);
+
+    return device ? device->name : "";
+}
+
+static const char *homeasy_name(struct registry *registry,
+        unsigned int address, int receiver, int group) {
+    const struct registry_device *device;
+    struct frame frame;
+
+    memset(&frame, 0, sizeof(frame));
+    frame.protocol = PROTOCOL_HOMEASY;
+    frame.homeasy.address = address;
+    frame.homeasy.receiver = receiver;
+    frame.homeasy.group = group;
+
+    device = registry_lookup(registry, &frame);
+
+    return device ? device->name : "";
+}
+
+static int check(const char *what, const char *name, const char *expected) {
+    if (strcmp(name, expected) != 0) {
+        fprintf(stderr, "%s: \"%s\" instead of \"%s\"\n", what, name,
+                expected);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int test_lookup() {
+    struct registry *registry;
+    int rtv = 0;
+
+    registry = load(
+        "verbose = 0;\n"
+        "gpio = 7;\n"
+        "devices = (\n"
+        "  { name = \"living room\"; protocol = \"somfy\"; address = 0xbeef; },\n"
+        "  { name = \"garden\"; protocol = \"homeasy\"; address = 1234567;\n"
+        "    receiver = 3; action = \"lights\"; },\n"
+        "  { name = \"remote\"; protocol = \"homeasy\"; address = 1234567; },\n"
+        "  { name = \"porch\"; protocol = \"homeasy\"; address = 42;\n"
+        "    receiver = 0; }\n"
+        ");\n");
+    if (registry == NULL) {
+        fprintf(stderr, "lookup: file refused\n");
+        return -1;
+    }
+
+    if (registry->count != 4 || registry->verbose != 0 ||
+            registry->gpio != 7) {
+        fprintf(stderr, "lookup: %u devices, verbose %d, gpio %d\n",
+                registry->count, registry->verbose, registry->gpio);
+        rtv = -1;
+    }
+
+    rtv |= check("somfy", somfy_name(registry, 0xbeef), "living room");
+    rtv |= check("somfy unknown", somfy_name(registry, 0xbeee), "");
+    rtv |= check("receiver", homeasy_name(registry, 1234567, 3, 0), "garden");
+    rtv |= check("other receiver", homeasy_name(registry, 1234567, 4, 0),
+            "remote");
+    rtv |= check("group", homeasy_name(registry, 1234567, 3, 1), "remote");
+    rtv |= check("no wildcard", homeasy_name(registry, 42, 1, 0), "");
+    rtv |= check("group no wildcard", homeasy_name(registry, 42, 0, 1), "");
+    rtv |= check("other protocol", homeasy_name(registry, 0xbeef, 0, 0), "");
+
+    registry_free(registry);
+
+    return rtv;
+}
+
+static int test_many() {
+    struct registry *registry;
+    char *content, name[32];
+    unsigned int i, len = 0;
+    int rtv = 0;
+
+    if ((content = (char *) malloc(REMOTES * 128 + 64)) == NULL) {
+        return -1;
+    }
+    len += sprintf(content, "devices = (\n");
+    for (i = 0; i != REMOTES; i++) {
+        len += sprintf(content + len, "  { name = \"r%u\"; protocol = \"%s\"; "
+                "address = %u; receiver = %d; }%s\n", i,
+                i & 1 ? "homeasy" : "somfy", i * 7919, i & 1 ? (int) i % 16 : -1,
+                i + 1 == REMOTES ? "" : ",");
+    }
+    sprintf(content + len, ");\n");
+
+    registry = load(content);
+    free(content);
+    if (registry == NULL) {
+        fprintf(stderr, "many: file refused\n");
+        return -1;
+    }
+
+    for (i = 0; i != REMOTES && rtv == 0; i++) {
+        sprintf(name, "r%u", i);
+        if (i & 1) {
+            rtv |= check("many", homeasy_name(registry, i * 7919, i % 16, 0),
+                    name);
+        } else {
+            rtv |= check("many", somfy_name(registry, i * 7919), name);
+        }
+    }
+    registry_free(registry);
+
+    return rtv;
+}
+
+static int refused(const char *what, const char *content) {
+    struct registry *registry;
+
+    if ((registry = load(content)) != NULL) {
+        fprintf(stderr, "%s: file accepted\n", what);
+        registry_free(registry);
+        return -1;
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    int rtv = 0;
+
+    rtv |= test_lookup();
+    rtv |= test_many();
+
+    rtv |= refused("duplicate", "devices = (\n"
+        "  { name = \"a\"; protocol = \"somfy\"; address = 1; },\n"
+        "  { name = \"b\"; protocol = \"somfy\"; address = 1; }\n"
+        ");\n");
+    rtv |= refused("protocol", "devices = (\n"
+        "  { name = \"a\"; protocol = \"x10\"; address = 1; }\n"
+        ");\n");
+    rtv |= refused("receiver", "devices = (\n"
+        "  { name = \"a\"; protocol = \"homeasy\"; address = 1; receiver = 16; }\n"
+        ");\n");
+    rtv |= refused("homeasy address", "devices = (\n"
+        "  { name = \"a\"; protocol = \"homeasy\"; address = 0x4000000; }\n"
+        ");\n");
+    rtv |= refused("somfy receiver", "devices = (\n"
+        "  { name = \"a\"; protocol = \"somfy\"; address = 1; receiver = 1; }\n"
+        ");\n");
+    rtv |= refused("no name", "devices = (\n"
+        "  { protocol = \"somfy\"; address = 1; }\n"
+        ");\n");
+    rtv |= refused("syntax", "devices = ( { name = \"a\"; ");
+
+    return rtv ? 1 : 0;
+}
@@ -0,0 +1,314 @@
+/*
+ * Copyright (C) 2014 Sylvain Afchain
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * Frames compiled by the real encoders, turned into pulses, damaged by a
+ * controlled amount of noise then decoded the way signal_eventd does. Fails
+ * when a clean or lightly jittered frame is lost, or when damaged frames
+ * decode to something else than what was sent more often than the 4 bits
+ * Somfy checksum allows, one in sixteen, with some slack.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include "srts.h"
+#include "homeasy.h"
+#include "pulse.h"
+
+struct noise {
+    /* pulse widths moved by up to this percent */
+    int jitter;
+    /* per mille of the pulses cut by a short spike of the other level */
+    int glitch;
+    /* per mille of the frames missing an edge pair */
+    int dropout;
+    /* lowest decode rate accepted, percent */
+    int expected;
+};
+
+static const struct noise levels[] = {
+    { 0, 0, 0, 100 },
+    { 5, 0, 0, 99 },
+    { 10, 0, 0, 0 },
+    { 15, 0, 0, 0 },
+    { 20, 0, 0, 0 },
+    { 0, 10, 0, 0 },
+    { 0, 50, 0, 0 },
+    { 0, 0, 100, 0 },
+    { 5, 10, 100, 0 },
+};
+
+#define LEVELS (sizeof(levels) / sizeof(levels[0]))
+
+struct pulses {
+    struct pulse *pulses;
+    unsigned int count;
+    unsigned int size;
+};
+
+int verbose = 0;
+
+/* reproducible from one run to the other */
+static unsigned int seed = 2463534242U;
+
+static unsigned int random32() {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+
+    return seed;
+}
+
+static void add_pulse(struct pulses *pulses, int type, unsigned int duration) {
+    if (pulses->count == pulses->size) {
+        pulses->size = pulses->size ? pulses->size * 2 : 1024;
+        pulses->pulses = (struct pulse *) realloc(pulses->pulses,
+                pulses->size * sizeof(struct pulse));
+        if (pulses->pulses == NULL) {
+            fprintf(stderr, "Memory allocation error\n");
+            exit(-1);
+        }
+    }
+    pulses->pulses[pulses->count].type = type;
+    pulses->pulses[pulses->count].duration = duration;
+    pulses->count++;
+}
+
+/* the pulses of a frame as a receiver would see them through the noise */
+static void render(struct timeline *timeline, const struct noise *noise,
+        struct pulses *pulses) {
+    unsigned long long end;
+    unsigned int i, duration, spike, dropped = -1;
+    int level;
+
+    pulses->count = 0;
+
+    /* never the sync, the frame would only be missed */
+    if ((int) (random32() % 1000) < noise->dropout) {
+        dropped = timeline->count / 2 + random32() % (timeline->count / 3);
+    }
+
+    for (i = 0; i != timeline->count; i++) {
+        level = timeline->edges[i].level;
+        if (i + 1 == timeline->count) {
+            end = timeline->length_ns;
+        } else {
+            end = timeline->edges[i + 1].offset_ns;
+        }
+        duration = (end - timeline->edges[i].offset_ns) / 1000;
+
+        if (noise->jitter) {
+            duration += (int) duration * ((int) (random32() %
+                        (noise->jitter * 20 + 1)) - noise->jitter * 10) / 1000;
+        }
+
+        /* the pulse swallows the two following ones */
+        if (i == dropped && i + 2 < timeline->count) {
+            end = i + 3 == timeline->count ? timeline->length_ns :
+                timeline->edges[i + 3].offset_ns;
+            duration = (end - timeline->edges[i].offset_ns) / 1000;
+            i += 2;
+        }
+
+        if ((int) (random32() % 1000) < noise->glitch && duration > 400) {
+            spike = 20 + random32() % 130;
+            add_pulse(pulses, level, (duration - spike) / 2);
+            add_pulse(pulses, ! level, spike);
+            add_pulse(pulses, level, duration - spike - (duration - spike) / 2);
+        } else {
+            add_pulse(pulses, level, duration);
+        }
+    }
+}
+
+static double now_ns() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+struct result {
+    unsigned int frames;
+    unsigned int decoded;
+    unsigned int wrong;
+    unsigned long edges;
+    double ns;
+};
+
+static int report(const char *name, const struct noise *noise,
+        struct result *result) {
+    double rate = result->decoded * 100.0 / result->frames;
+
+    printf("%-8s %6d%% %7d%% %7d%% %7u %8u %6u %8.1f%% %8.1f\n", name,
+            noise->jitter, noise->glitch / 10, noise->dropout / 10,
+            result->frames, result->decoded, result->wrong, rate,
+            result->ns / result->edges);
+
+    if (result->wrong > (result->frames - result->decoded) / 8) {
+        fprintf(stderr, "%s: %u frames decoded wrong\n", name, result->wrong);
+        return -1;
+    }
+    if (rate < noise->expected) {
+        fprintf(stderr, "%s: %.1f%% decoded, %d%% expected\n", name, rate,
+                noise->expected);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* every command, addresses and codes spread over their whole range */
+static int test_somfy(const struct noise *noise, struct pulses *pulses) {
+    struct srts_payload payload;
+    struct pulse_filter filter = { 0 };
+    struct timeline timeline;
+    struct result result;
+    unsigned int address, code, duration, i, decoded;
+    unsigned char key;
+    double start;
+    char command;
+
+    memset(&result, 0, sizeof(result));
+    timeline_init(&timeline);
+
+    for (command = MY; command <= FLAG; command++) {
+        /* 7 is not a command */
+        if (command == 7) {
+            continue;
+        }
+        for (address = 1; address <= 0xffff; address += 1021) {
+            key = random32();
+            code = random32() & 0xffff;
+
+            timeline_clear(&timeline);
+            srts_compile(&timeline, key, address, command, code, 0);
+            render(&timeline, noise, pulses);
+
+            decoded = 0;
+            start = now_ns();
+            for (i = 0; i != pulses->count; i++) {
+                if (pulse_filter(&filter, pulses->pulses[i].duration,
+                            &duration) && srts_receive(pulses->pulses[i].type,
+                            duration, &payload) == 1) {
+                    decoded++;
+                }
+            }
+            result.ns += now_ns() - start;
+            result.edges += pulses->count;
+            result.frames++;
+
+            if (decoded == 0) {
+                continue;
+            }
+            if (decoded == 1 && payload.key == key && payload.ctrl == command &&
+                    ntohs(payload.code) == code && payload.address.byte1 ==
+                    (address & 0xff) && payload.address.byte2 == address >> 8) {
+                result.decoded++;
+            } else {
+                result.wrong++;
+            }
+        }
+    }
+    timeline_free(&timeline);
+
+    return report("somfy", noise, &result);
+}
+
+static int test_homeasy(const struct noise *noise, struct pulses *pulses) {
+    struct homeasy_decoder decoder;
+    struct homeasy_frame frame;
+    struct pulse_filter filter = { 0 };
+    struct timeline timeline;
+    struct result result;
+    unsigned int address, duration, i, decoded;
+    unsigned char receiver, command;
+    int group;
+    double start;
+
+    memset(&result, 0, sizeof(result));
+    timeline_init(&timeline);
+    homeasy_decoder_init(&decoder);
+
+    for (command = HOMEASY_OFF; command <= HOMEASY_ON; command++) {
+        for (receiver = 0; receiver != 16; receiver++) {
+            for (address = 1; address < (1 << 26); address += 1048573) {
+                group = address & 1;
+
+                timeline_clear(&timeline);
+                homeasy_compile(&timeline, address, receiver, command, group);
+                render(&timeline, noise, pulses);
+
+                decoded = 0;
+                start = now_ns();
+                for (i = 0; i != pulses->count; i++) {
+                    if (pulse_filter(&filter, pulses->pulses[i].duration,
+                                &duration) && homeasy_decoder_feed(&decoder,
+                                pulses->pulses[i].type, duration, &frame) == 1) {
+                        decoded++;
+                    }
+                }
+                result.ns += now_ns() - start;
+                result.edges += pulses->count;
+                result.frames++;
+
+                if (decoded == 0) {
+                    continue;
+                }
+                if (decoded == 1 && frame.address == address &&
+                        frame.receiver == receiver && frame.command == command &&
+                        frame.group == group) {
+                    result.decoded++;
+                } else {
+                    result.wrong++;
+                }
+            }
+        }
+    }
+    timeline_free(&timeline);
+
+    return report("homeasy", noise, &result);
+}
+
+int main(int argc, char **argv) {
+    struct pulses pulses;
+    unsigned int i;
+    int rtv = 0;
+
+    memset(&pulses, 0, sizeof(pulses));
+
+    printf("%-8s %7s %8s %8s %7s %8s %6s %9s %8s\n", "protocol", "jitter",
+            "glitch", "dropout", "frames", "decoded", "wrong", "accuracy",
+            "ns/edge");
+    for (i = 0; i != LEVELS; i++) {
+        if (test_somfy(&levels[i], &pulses) == -1) {
+            rtv = 1;
+        }
+    }
+    for (i = 0; i != LEVELS; i++) {
+        if (test_homeasy(&levels[i], &pulses) == -1) {
+            rtv = 1;
+        }
+    }
+    free(pulses.pulses);
+
+    return rtv;
+}
@@ -0,0 +1,178 @@
+/*
+ * Copyright (C) 2014 Sylvain Afchain
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * Somfy and HomeEasy frames written to sample files, one byte per sample
+ * and bit packed, then read back in odd sized chunks through samples_scan.
+ * Every edge must be found at its sample and every frame decoded.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "protocol.h"
+#include "samples.h"
+#include "pulse.h"
+
+#define RATE 1000000
+#define CHUNK 4093
+
+struct capture {
+    struct protocol_dispatch dispatch;
+    struct pulse_filter filter;
+    unsigned int edges;
+    unsigned int frames[PROTOCOL_COUNT];
+};
+
+int verbose = 0;
+
+static void count_frame(struct frame *frame, void *arg) {
+    struct capture *capture = (struct capture *) arg;
+
+    capture->frames[frame->protocol]++;
+}
+
+static void decode_pulse(int type, unsigned int duration, void *arg) {
+    struct capture *capture = (struct capture *) arg;
+    unsigned int merged;
+
+    capture->edges++;
+    if (pulse_filter(&capture->filter, duration, &merged)) {
+        protocol_feed(&capture->dispatch, type, merged);
+    }
+}
+
+/* at RATE every micro second is a sample, edges fall on exact samples */
+static int write_samples(struct timeline *timeline, int format,
+        const char *path) {
+    unsigned long long count, n;
+    unsigned char *buffer;
+    unsigned int i;
+    size_t size;
+    FILE *fp;
+
+    count = timeline->length_ns / 1000;
+    size = format == SAMPLES_BIT ? (count + 7) / 8 : count;
+    if ((buffer = (unsigned char *) calloc(size, 1)) == NULL) {
+        return -1;
+    }
+
+    for (i = 0; i != timeline->count; i++) {
+        if (! timeline->edges[i].level) {
+            continue;
+        }
+        n = timeline->edges[i].offset_ns / 1000;
+        for (; n != (i + 1 == timeline->count ? count :
+                    timeline->edges[i + 1].offset_ns / 1000); n++) {
+            if (format == SAMPLES_BIT) {
+                buffer[n / 8] |= 0x80 >> (n % 8);
+            } else {
+                buffer[n] = 180 + n % 50;
+            }
+        }
+    }
+    /* low samples just below the threshold */
+    if (format == SAMPLES_U8) {
+        for (n = 0; n != count; n++) {
+            if (buffer[n] == 0) {
+                buffer[n] = n % 128;
+            }
+        }
+    }
+
+    if ((fp = fopen(path, "w")) == NULL ||
+            fwrite(buffer, 1, size, fp) != size || fclose(fp) != 0) {
+        free(buffer);
+        return -1;
+    }
+    free(buffer);
+
+    return 0;
+}
+
+static int read_samples(int format, const char *path,
+        struct capture *capture) {
+    unsigned char buffer[CHUNK];
+    struct samples samples;
+    size_t len;
+    FILE *fp;
+
+    memset(capture, 0, sizeof(struct capture));
+    protocol_init(&capture->dispatch, count_frame, capture);
+    samples_init(&samples, format, RATE, 128, decode_pulse, capture);
+
+    if ((fp = fopen(path, "r")) == NULL) {
+        return -1;
+    }
+    while ((len = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
+        samples_scan(&samples, buffer, len);
+    }
+    samples_flush(&samples);
+    fclose(fp);
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    const char *formats[] = { "u8", "bit" };
+    struct capture capture;
+    struct timeline timeline;
+    char path[] = "/tmp/test_samples.XXXXXX";
+    int format, fd, rtv = 0, i;
+
+    if ((fd = mkstemp(path)) == -1) {
+        perror("mkstemp");
+        return 1;
+    }
+    close(fd);
+
+    timeline_init(&timeline);
+    srts_compile(&timeline, 0x42, 1234, UP, 17, 0);
+    for (i = 0; i != 7; i++) {
+        srts_compile(&timeline, 0x42, 1234, UP, 17, 1);
+    }
+    for (i = 0; i != 5; i++) {
+        homeasy_compile(&timeline, 0x2abcdef, 9, HOMEASY_ON, 0);
+    }
+
+    for (format = SAMPLES_U8; format <= SAMPLES_BIT; format++) {
+        if (write_samples(&timeline, format, path) == -1 ||
+                read_samples(format, path, &capture) == -1) {
+            fprintf(stderr, "%s: unable to use %s\n", formats[format], path);
+            rtv = 1;
+            continue;
+        }
+
+        /* the first edge only starts the first pulse */
+        printf("%s: %u edges, %u somfy frames, %u homeasy frames\n",
+                formats[format], capture.edges, capture.frames[PROTOCOL_SRTS],
+                capture.frames[PROTOCOL_HOMEASY]);
+        if (capture.edges != timeline.count ||
+                capture.frames[PROTOCOL_SRTS] != 8 ||
+                capture.frames[PROTOCOL_HOMEASY] != 5) {
+            fprintf(stderr, "%s: expected %u edges, 8 somfy frames and 5 "
+                    "homeasy frames\n", formats[format], timeline.count);
+            rtv = 1;
+        }
+    }
+
+    timeline_free(&timeline);
+    unlink(path);
+
+    return rtv;
+}
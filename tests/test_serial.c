@@ -0,0 +1,231 @@
+/*
+ * Copyright (C) 2014 Sylvain Afchain
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * The host side of the transmit coprocessor protocol against a pseudo
+ * terminal. A thread plays the board, as arduino/srts.ino does, and can be
+ * told to lose messages, to reboot, to add line noise or to stay mute.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+
+#include "protocol.h"
+#include "serial.h"
+
+enum BOARD_FAULT {
+    BOARD_OK = 0,
+    /* answers the first command with a boot announce and drops it */
+    BOARD_REBOOT,
+    /* the first accepted ack is lost on the line */
+    BOARD_LOSE_ACCEPT,
+    /* garbage, with a stray magic, before every ack */
+    BOARD_NOISE,
+    /* never answers */
+    BOARD_MUTE
+};
+
+struct board {
+    int master;
+    int fault;
+    int seen;
+    unsigned int commands;
+    unsigned int transmissions;
+    struct serial_command last;
+    pthread_t thread;
+};
+
+static void send_ack(struct board *board, unsigned char seq,
+        unsigned char status, unsigned char frames, unsigned int airtime) {
+    static const unsigned char noise[] = { 0x00, SERIAL_ACK_MAGIC, 0x13, 0xff };
+    unsigned char buffer[SERIAL_ACK_SIZE];
+    struct serial_ack ack;
+
+    ack.seq = seq;
+    ack.status = status;
+    ack.frames = frames;
+    ack.airtime = airtime;
+    ack.late = 3;
+    serial_pack_ack(&ack, buffer);
+
+    if (board->fault == BOARD_NOISE &&
+            write(board->master, noise, sizeof(noise)) == -1) {
+        return;
+    }
+    if (write(board->master, buffer, SERIAL_ACK_SIZE) == -1) {
+        return;
+    }
+}
+
+static void *board_thread(void *arg) {
+    struct board *board = (struct board *) arg;
+    unsigned char buffer[SERIAL_COMMAND_SIZE];
+    struct serial_command command;
+    int len = 0, rtv, first = 1;
+
+    while ((rtv = read(board->master, buffer + len,
+                    SERIAL_COMMAND_SIZE - len)) > 0) {
+        len += rtv;
+        if (buffer[0] != SERIAL_COMMAND_MAGIC) {
+            memmove(buffer, buffer + 1, --len);
+            continue;
+        }
+        if (len != SERIAL_COMMAND_SIZE) {
+            continue;
+        }
+        len = 0;
+
+        board->commands++;
+        if (board->fault == BOARD_MUTE) {
+            continue;
+        }
+        if (serial_unpack_command(buffer, &command) == -1) {
+            send_ack(board, buffer[3], SERIAL_BAD_CRC, 0, 0);
+            continue;
+        }
+        if (board->fault == BOARD_REBOOT && first) {
+            first = 0;
+            send_ack(board, 0, SERIAL_READY, 0, 0);
+            continue;
+        }
+        if (command.protocol >= PROTOCOL_COUNT || command.frames == 0) {
+            send_ack(board, command.seq, SERIAL_BAD_COMMAND, 0, 0);
+            continue;
+        }
+
+        /* a command sent again, its accepted ack was lost */
+        if (board->seen && command.seq == board->last.seq) {
+            send_ack(board, command.seq, SERIAL_ACCEPTED, 0, 0);
+            continue;
+        }
+        board->seen = 1;
+        board->last = command;
+
+        if (board->fault == BOARD_LOSE_ACCEPT && first) {
+            first = 0;
+        } else {
+            send_ack(board, command.seq, SERIAL_ACCEPTED, 0, 0);
+        }
+        board->transmissions++;
+
+        /* long enough for the host to send the command again */
+        usleep(board->fault == BOARD_LOSE_ACCEPT ? 2 * SERIAL_ACCEPT_MS * 1000 :
+                10000);
+        send_ack(board, command.seq, SERIAL_DONE, command.frames,
+                command.frames * 100000);
+    }
+
+    return NULL;
+}
+
+static int board_start(struct board *board, int fault) {
+    memset(board, 0, sizeof(struct board));
+    board->fault = fault;
+
+    if ((board->master = posix_openpt(O_RDWR | O_NOCTTY)) == -1 ||
+            grantpt(board->master) == -1 || unlockpt(board->master) == -1) {
+        perror("posix_openpt");
+        return -1;
+    }
+
+    return serial_open(ptsname(board->master));
+}
+
+static void board_stop(struct board *board, int fd) {
+    close(fd);
+    pthread_join(board->thread, NULL);
+    close(board->master);
+}
+
+static int check(const char *name, int fault, struct serial_command *command,
+        int expected, unsigned int transmissions) {
+    struct board board;
+    struct serial_ack ack;
+    int fd, rtv;
+
+    if ((fd = board_start(&board, fault)) == -1) {
+        return -1;
+    }
+    pthread_create(&board.thread, NULL, board_thread, &board);
+
+    rtv = serial_transmit(fd, command, &ack, 2000);
+    board_stop(&board, fd);
+
+    printf("%-14s rtv: %2d, commands: %u, transmissions: %u\n", name, rtv,
+            board.commands, board.transmissions);
+    if (rtv != expected || board.transmissions != transmissions) {
+        fprintf(stderr, "%s: expected %d and %u transmissions\n", name,
+                expected, transmissions);
+        return -1;
+    }
+    if (rtv == -1) {
+        return 0;
+    }
+
+    if (board.last.protocol != command->protocol ||
+            board.last.flags != command->flags ||
+            board.last.address != command->address ||
+            board.last.command != command->command ||
+            board.last.key != command->key ||
+            board.last.receiver != command->receiver ||
+            board.last.code != command->code || ack.seq != command->seq || ack.frames != command->frames ||
+            ack.airtime != command->frames * 100000 || ack.late != 3) {
+        fprintf(stderr, "%s: command or ack altered on the line\n", name);
+        return -1;
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    struct serial_command somfy, homeasy, bad;
+    int rtv = 0;
+
+    memset(&somfy, 0, sizeof(somfy));
+    somfy.protocol = PROTOCOL_SRTS;
+    somfy.seq = 0x42;
+    somfy.address = 0xbeef;
+    somfy.command = DOWN;
+    somfy.key = 0xa7;
+    somfy.code = 0xd7d7;
+    somfy.frames = 8;
+
+    memset(&homeasy, 0, sizeof(homeasy));
+    homeasy.protocol = PROTOCOL_HOMEASY;
+    homeasy.flags = SERIAL_GROUP;
+    homeasy.seq = 0xff;
+    homeasy.address = 0x2abcdef;
+    homeasy.command = HOMEASY_ON;
+    homeasy.frames = 25;
+
+    bad = somfy;
+    bad.protocol = PROTOCOL_COUNT;
+
+    rtv |= check("somfy", BOARD_OK, &somfy, 0, 1);
+    rtv |= check("homeasy", BOARD_OK, &homeasy, 0, 1);
+    rtv |= check("reboot", BOARD_REBOOT, &somfy, 0, 1);
+    rtv |= check("lost accept", BOARD_LOSE_ACCEPT, &somfy, 0, 1);
+    rtv |= check("noise", BOARD_NOISE, &homeasy, 0, 1);
+    rtv |= check("rejected", BOARD_OK, &bad, -1, 0);
+    rtv |= check("mute", BOARD_MUTE, &somfy, -1, 0);
+
+    return rtv ? 1 : 0;
+}